@@ -0,0 +1,277 @@
+//=========================================================================================================
+// AsyncFile.cpp - Writes output files with overlapped (asynchronous) I/O
+//=========================================================================================================
+#include "stdafx.h"
+#include "AsyncFile.h"
+#include "Globals.h"
+
+//=========================================================================================================
+// Variables common to all instances of this class
+//=========================================================================================================
+CCriticalSection CAsyncFile::m_stats_cs;
+U64              CAsyncFile::m_total_bytes;
+U64              CAsyncFile::m_wait_ticks;
+U64              CAsyncFile::m_first_submit_ticks;
+U64              CAsyncFile::m_last_done_ticks;
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Constructor() - Starts out with no file open and no buffers allocated.  A file that was never opened
+//                 has no failed writes, so closing it succeeds
+//=========================================================================================================
+CAsyncFile::CAsyncFile()
+{
+    m_hfile    = INVALID_HANDLE_VALUE;
+    m_current  = 0;
+    m_position = 0;
+    m_ok       = true;
+    for (U32 i=0; i<ASYNC_BUFFER_COUNT; ++i)
+    {
+        m_buffer[i].data      = nullptr;
+        m_buffer[i].in_flight = false;
+        m_buffer[i].ov.hEvent = nullptr;
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Create() - Creates the file and allocates our buffers
+//=========================================================================================================
+bool CAsyncFile::Create(CString fn)
+{
+    // Make sure any file we previously had open is closed
+    Close();
+
+    // Create the file for overlapped writes
+    m_hfile = CreateFile(fn, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+    if (m_hfile == INVALID_HANDLE_VALUE) return false;
+
+    // Keep track of the file name
+    m_fn = fn;
+
+    // Allocate the buffers.  Each one gets an event that is signalled when its write finishes
+    for (U32 i=0; i<ASYNC_BUFFER_COUNT; ++i)
+    {
+        buffer& b = m_buffer[i];
+        b.data      = (U8*)AllocateBuffer(ASYNC_BUFFER_SIZE);
+        b.used      = 0;
+        b.in_flight = false;
+        memset(&b.ov, 0, sizeof b.ov);
+        b.ov.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        if (b.data == nullptr || b.ov.hEvent == nullptr)
+        {
+            Close(true);
+            return false;
+        }
+    }
+
+    // We're filling the first buffer, at the start of the file
+    m_current  = 0;
+    m_position = 0;
+    m_ok       = true;
+
+    // Tell the caller that all is well
+    return true;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// SetSize() - Sets the size of the file
+//=========================================================================================================
+bool CAsyncFile::SetSize(U64 size)
+{
+    LARGE_INTEGER position;
+
+    position.QuadPart = size;
+    return SetFilePointerEx(m_hfile, position, nullptr, FILE_BEGIN) && SetEndOfFile(m_hfile);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Submit() - Hands the current buffer to the operating system to be written, and moves on to the next
+//            buffer
+//=========================================================================================================
+void CAsyncFile::Submit()
+{
+    LARGE_INTEGER now;
+
+    buffer& b = m_buffer[m_current];
+
+    // If there's nothing in the buffer (or it has already been handed over), there's nothing to do
+    if (b.used == 0 || b.in_flight) return;
+
+    // Tell the operating system where in the file this buffer goes
+    b.ov.Offset     = (DWORD)(b.offset);
+    b.ov.OffsetHigh = (DWORD)(b.offset >> 32);
+
+    // Start the write.  It may complete immediately, or it may be pending
+    if (WriteFile(m_hfile, b.data, b.used, nullptr, &b.ov) || GetLastError() == ERROR_IO_PENDING)
+        b.in_flight = true;
+    else
+    {
+        m_ok   = false;
+        b.used = 0;
+    }
+
+    // Keep track of how much data we've written, and when the first write started
+    QueryPerformanceCounter(&now);
+    m_stats_cs.Lock();
+    m_total_bytes += b.used;
+    if (b.in_flight && m_first_submit_ticks == 0) m_first_submit_ticks = now.QuadPart;
+    m_stats_cs.Unlock();
+
+    // Move on to the next buffer
+    m_current = (m_current + 1) % ASYNC_BUFFER_COUNT;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WaitFor() - Waits for the write of a buffer to finish, so the buffer can be re-used
+//=========================================================================================================
+void CAsyncFile::WaitFor(U32 i)
+{
+    LARGE_INTEGER start, stop;
+    DWORD         bytes_written;
+
+    buffer& b = m_buffer[i];
+
+    // If this buffer isn't being written, there's nothing to wait for
+    if (!b.in_flight) return;
+
+    // Wait for the write to finish, and find out whether it worked
+    QueryPerformanceCounter(&start);
+    if (!GetOverlappedResult(m_hfile, &b.ov, &bytes_written, TRUE) || bytes_written != b.used) m_ok = false;
+    QueryPerformanceCounter(&stop);
+
+    // Keep track of how long we spent waiting, and when the last write finished
+    m_stats_cs.Lock();
+    m_wait_ticks += stop.QuadPart - start.QuadPart;
+    if ((U64)stop.QuadPart > m_last_done_ticks) m_last_done_ticks = stop.QuadPart;
+    m_stats_cs.Unlock();
+
+    // The buffer is free
+    b.in_flight = false;
+    b.used      = 0;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Write() - Copies data into our buffers, starting a write each time a buffer fills up
+//=========================================================================================================
+bool CAsyncFile::Write(const void* data, size_t length)
+{
+    const U8* p = (const U8*)data;
+
+    // If the file isn't open, we can't write anything
+    if (!IsOpen()) return false;
+
+    // If this data doesn't follow on from the data already in the current buffer, start a new buffer
+    buffer* b = &m_buffer[m_current];
+    if (!b->in_flight && b->used && m_position != b->offset + b->used) Submit();
+
+    while (length)
+    {
+        // If we're starting a new buffer, make sure its last write is finished, and note where it goes
+        b = &m_buffer[m_current];
+        WaitFor(m_current);
+        if (b->used == 0) b->offset = m_position;
+
+        // Copy as much of the data as will fit
+        U32 count = ASYNC_BUFFER_SIZE - b->used;
+        if (count > length) count = (U32)length;
+        memcpy(b->data + b->used, p, count);
+        b->used    += count;
+        m_position += count;
+        p          += count;
+        length     -= count;
+
+        // If the buffer is full, write it
+        if (b->used == ASYNC_BUFFER_SIZE) Submit();
+    }
+
+    // Tell the caller whether all of our writes have worked so far
+    return m_ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Close() - Writes whatever is left in the current buffer, waits for every write to finish, and closes
+//           the file.  A file that we couldn't completely write is deleted
+//=========================================================================================================
+bool CAsyncFile::Close(bool erase)
+{
+    bool ok = m_ok;
+
+    // If the file is open, finish it and close it
+    if (IsOpen())
+    {
+        // Write the last partial buffer and wait for everything to land
+        Submit();
+        for (U32 i=0; i<ASYNC_BUFFER_COUNT; ++i) WaitFor(i);
+        ok = m_ok;
+
+        CloseHandle(m_hfile);
+        m_hfile = INVALID_HANDLE_VALUE;
+
+        // If we've been asked to (or a write failed), delete the file
+        if (erase || !ok) DeleteFile(m_fn);
+    }
+
+    // Free our buffers and events
+    for (U32 i=0; i<ASYNC_BUFFER_COUNT; ++i)
+    {
+        buffer& b = m_buffer[i];
+        FreeBuffer(b.data);
+        if (b.ov.hEvent) CloseHandle(b.ov.hEvent);
+        b.data      = nullptr;
+        b.ov.hEvent = nullptr;
+        b.in_flight = false;
+    }
+
+    // Tell the caller whether every write worked
+    return ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ResetStats() - Resets the statistics that are kept for all files
+//=========================================================================================================
+void CAsyncFile::ResetStats()
+{
+    m_stats_cs.Lock();
+    m_total_bytes        = 0;
+    m_wait_ticks         = 0;
+    m_first_submit_ticks = 0;
+    m_last_done_ticks    = 0;
+    m_stats_cs.Unlock();
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// GetStats() - Fetches the number of bytes written, the time from the first write starting to the last
+//              one finishing, and the time spent waiting for writes to finish
+//=========================================================================================================
+void CAsyncFile::GetStats(U64* bytes, double* write_seconds, double* wait_seconds)
+{
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceFrequency(&frequency);
+
+    m_stats_cs.Lock();
+    *bytes         = m_total_bytes;
+    *write_seconds = 0;
+    if (m_last_done_ticks > m_first_submit_ticks && m_first_submit_ticks)
+        *write_seconds = (double)(m_last_done_ticks - m_first_submit_ticks) / frequency.QuadPart;
+    *wait_seconds  = (double)m_wait_ticks / frequency.QuadPart;
+    m_stats_cs.Unlock();
+}
+//=========================================================================================================
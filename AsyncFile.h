@@ -0,0 +1,103 @@
+//=========================================================================================================
+// AsyncFile.h - Describes the class that writes output files with overlapped (asynchronous) I/O
+//=========================================================================================================
+#pragma once
+#include "stdafx.h"
+#include "typedefs.h"
+
+// The number of write buffers per file, and the size of each one
+#define ASYNC_BUFFER_COUNT 16
+#define ASYNC_BUFFER_SIZE  (1024 * 1024)
+
+//=========================================================================================================
+// CAsyncFile - An output file that works like a FILE* opened for writing, but whose writes are carried
+//              out in the background.  Data is copied into our own buffers, and writes to adjacent
+//              positions in the file are gathered into the same buffer.  When a buffer fills up (or the
+//              next write goes somewhere else in the file), it is handed to the operating system as an
+//              overlapped write, and we carry on filling the next buffer.  Up to ASYNC_BUFFER_COUNT
+//              writes can be in flight at once.
+//
+//              A write that fails is reported by the next call to "Write()" or "Close()", and the file
+//              is deleted when it is closed.
+//=========================================================================================================
+class CAsyncFile
+{
+public:
+
+    // Default constructor
+    CAsyncFile();
+
+    // Destructor closes the file if it's still open
+    ~CAsyncFile() {Close();}
+
+    // Creates the file, replacing any existing file of the same name
+    bool    Create(CString fn);
+
+    // Returns true if the file is open
+    bool    IsOpen() {return m_hfile != INVALID_HANDLE_VALUE;}
+
+    // Sets the size of the file.  Setting it in advance means writes never have to extend the file
+    bool    SetSize(U64 size);
+
+    // Moves the position that the next write will go to
+    void    Seek(U64 offset) {m_position = offset;}
+
+    // Returns the position that the next write will go to
+    U64     Tell() {return m_position;}
+
+    // Writes data at the current position, and moves the position past it
+    bool    Write(const void* data, size_t length);
+
+    // Waits for every write to finish and closes the file.  The file is deleted if we've been asked to,
+    // or if any write failed (in which case this returns false)
+    bool    Close(bool erase = false);
+
+    // Resets the statistics that are kept for all files
+    static void ResetStats();
+
+    // Fetches the number of bytes written to all files, the time from the first write starting to the
+    // last one finishing, and the time spent waiting for writes to finish
+    static void GetStats(U64* bytes, double* write_seconds, double* wait_seconds);
+
+protected:
+
+    // A buffer and the write that it is used for
+    struct buffer
+    {
+        U8*         data;
+        U32         used;
+        U64         offset;
+        bool        in_flight;
+        OVERLAPPED  ov;
+    };
+
+    // Hands the current buffer to the operating system to be written
+    void    Submit();
+
+    // Waits for the write of buffer "i" (if there is one) to finish
+    void    WaitFor(U32 i);
+
+    // The name of the file
+    CString     m_fn;
+
+    // The file itself
+    HANDLE      m_hfile;
+
+    // Our write buffers, and the index of the one we're filling
+    buffer      m_buffer[ASYNC_BUFFER_COUNT];
+    U32         m_current;
+
+    // The file position that the next write will go to
+    U64         m_position;
+
+    // This will be false if any write has failed
+    bool        m_ok;
+
+    // Statistics for all files
+    static CCriticalSection m_stats_cs;
+    static U64  m_total_bytes;
+    static U64  m_wait_ticks;
+    static U64  m_first_submit_ticks;
+    static U64  m_last_done_ticks;
+};
+//=========================================================================================================
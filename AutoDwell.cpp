@@ -0,0 +1,98 @@
+//=========================================================================================================
+// AutoDwell.cpp - Picks the dwell limit for a region of the complex plane
+//
+// A dwell limit that's too low leaves black blobs where points haven't escaped yet, and one that's too
+// high wastes time on points that never will.  The planner iterates a sparse grid of points across the
+// region, doubling the iteration limit until raising it stops turning up more than a handful of newly
+// escaped points.  At that point the distribution of escape counts has saturated, and the dwell limit
+// is the smallest one that all but a tolerable fraction of the escaping points escape within.
+//
+// Interior points are stopped early by the iterators' interior detection, so they cost next to nothing
+// no matter how high the iteration limit climbs.  The points are iterated by the plotter threads, so
+// the planner must be called from the worker thread while the plotters are idle.
+//=========================================================================================================
+#include "stdafx.h"
+#include "Globals.h"
+#include "Plotter.h"
+#include <algorithm>
+#include <functional>
+
+// The planner samples a grid of this many points across and down the region
+static const U32 AUTO_DWELL_GRID = 64;
+
+// The first iteration limit the planner tries, and the highest it will go
+static const U32 AUTO_DWELL_START = 256;
+static const U32 AUTO_DWELL_MAX   = 1 << 20;
+
+// The fraction of the sampled points that may still be unresolved at the chosen dwell limit
+static const double AUTO_DWELL_TOLERANCE = 0.002;
+
+
+//=========================================================================================================
+// PlanDwell() - Picks the dwell limit for a region of the complex plane.  The region can be a whole view
+//               or any part of one, such as a single panel of a render
+//=========================================================================================================
+U32 PlanDwell(const T_COORD& region)
+{
+    const U32 G = AUTO_DWELL_GRID;
+    vector<complex> pending, unresolved;
+    vector<U32>     escaped;
+    vector<escape>  results;
+
+    // The points we sample are in the center of each cell of the grid
+    double min_real = region.center.real - region.span.real / 2;
+    double max_imag = region.center.imag + region.span.imag / 2;
+    for (U32 y=0; y<G; ++y)
+    {
+        for (U32 x=0; x<G; ++x)
+        {
+            complex c = {min_real + region.span.real * (x + 0.5) / G, max_imag - region.span.imag * (y + 0.5) / G};
+            pending.push_back(c);
+        }
+    }
+
+    // This is how many newly escaped points we can ignore
+    U32 tolerance = (U32)(AUTO_DWELL_TOLERANCE * G * G);
+
+    // Keep raising the iteration limit until the escape counts stop changing
+    for (U32 limit = AUTO_DWELL_START; !pending.empty() && !aborting; limit *= 2)
+    {
+        U32 new_escapes = 0;
+
+        // Iterate every point that hasn't escaped yet, sharing them out among the plotter threads
+        CPlotter::IteratePoints(pending, limit, results);
+
+        // Set aside the ones that escaped
+        unresolved.clear();
+        for (size_t i=0; i<pending.size(); ++i)
+        {
+            if (results[i].iter > 0)
+            {
+                escaped.push_back(results[i].iter);
+                ++new_escapes;
+            }
+            else
+                unresolved.push_back(pending[i]);
+        }
+        pending.swap(unresolved);
+
+        // If raising the limit barely turned up any new escapes, the distribution has saturated
+        if (limit > AUTO_DWELL_START && new_escapes <= tolerance) break;
+
+        // Don't go on forever
+        if (limit >= AUTO_DWELL_MAX) break;
+    }
+
+    // Find the smallest dwell that all but "tolerance" of the escaped points escape within
+    U32 result = 0;
+    if (escaped.size() > tolerance)
+    {
+        std::nth_element(escaped.begin(), escaped.begin() + tolerance, escaped.end(), std::greater<U32>());
+        result = escaped[tolerance];
+    }
+
+    // Round it up to a tidy number, and never go below the default
+    result = (result + 99) / 100 * 100;
+    return (result < DEFAULT_DWELL) ? DEFAULT_DWELL : result;
+}
+//=========================================================================================================
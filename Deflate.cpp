@@ -0,0 +1,384 @@
+//=========================================================================================================
+// Deflate.cpp - A small, fast DEFLATE (RFC 1951) compressor and the zlib (RFC 1950) wrapper around it
+//
+// This compressor only emits fixed-Huffman blocks and uses a short, greedy LZ77 match search.  It is
+// not as tight as zlib at its higher levels, but rendered fractals are dominated by long runs and
+// repeated rows, which this handles well, and it is fast enough to keep up with the plotters.
+//=========================================================================================================
+#include "stdafx.h"
+#include "Deflate.h"
+
+//=========================================================================================================
+// Handy constants
+//=========================================================================================================
+static const U32 ADLER_BASE = 65521;
+static const int WINDOW_SIZE = 32768;
+static const int HASH_BITS   = 15;
+static const int HASH_SIZE   = 1 << HASH_BITS;
+static const int MAX_CHAIN   = 8;
+static const int MIN_MATCH   = 3;
+static const int MAX_MATCH   = 258;
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CBitWriter - Appends a stream of bits, least significant bit first, to a byte vector
+//=========================================================================================================
+class CBitWriter
+{
+public:
+
+    CBitWriter(vector<U8>& out) : m_out(out) {m_bits = 0; m_count = 0;}
+
+    // Writes the low "count" bits of "value"
+    void Put(U32 value, U32 count)
+    {
+        m_bits  |= (U64)value << m_count;
+        m_count += count;
+        while (m_count >= 8)
+        {
+            m_out.push_back((U8)m_bits);
+            m_bits  >>= 8;
+            m_count  -= 8;
+        }
+    }
+
+    // Pads the stream with zero bits out to the next byte boundary
+    void Align()
+    {
+        if (m_count) m_out.push_back((U8)m_bits);
+        m_bits  = 0;
+        m_count = 0;
+    }
+
+protected:
+
+    vector<U8>& m_out;
+    U64         m_bits;
+    U32         m_count;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ReverseBits() - Returns the low "count" bits of "value" in reverse order
+//=========================================================================================================
+static U32 ReverseBits(U32 value, U32 count)
+{
+    U32 result = 0;
+    while (count--)
+    {
+        result = (result << 1) | (value & 1);
+        value >>= 1;
+    }
+    return result;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CFixedCodes - The fixed Huffman codes from RFC 1951 section 3.2.6, pre-reversed so they can be
+//               written least significant bit first
+//=========================================================================================================
+static struct CFixedCodes
+{
+    U16 lit_code[288];
+    U8  lit_bits[288];
+    U8  dist_code[30];
+
+    CFixedCodes()
+    {
+        for (U32 sym=0; sym<288; ++sym)
+        {
+            U32 code, bits;
+            if      (sym < 144) {code = 0x30  + sym;         bits = 8;}
+            else if (sym < 256) {code = 0x190 + (sym - 144); bits = 9;}
+            else if (sym < 280) {code = sym - 256;           bits = 7;}
+            else                {code = 0xC0  + (sym - 280); bits = 8;}
+            lit_code[sym] = (U16)ReverseBits(code, bits);
+            lit_bits[sym] = (U8)bits;
+        }
+
+        for (U32 sym=0; sym<30; ++sym) dist_code[sym] = (U8)ReverseBits(sym, 5);
+    }
+} fixed;
+//=========================================================================================================
+
+
+//=========================================================================================================
+// HighBit() - Returns the index of the most significant set bit of a non-zero value
+//=========================================================================================================
+static U32 HighBit(U32 value)
+{
+    unsigned long index;
+    _BitScanReverse(&index, value);
+    return index;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// PutLiteral() - Writes a literal byte (or the end-of-block code) to the bit stream
+//=========================================================================================================
+static inline void PutLiteral(CBitWriter& bw, U32 sym)
+{
+    bw.Put(fixed.lit_code[sym], fixed.lit_bits[sym]);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// PutMatch() - Writes a length/distance pair to the bit stream
+//=========================================================================================================
+static void PutMatch(CBitWriter& bw, U32 length, U32 distance)
+{
+    // Write the length code and its extra bits
+    if (length == MAX_MATCH)
+        PutLiteral(bw, 285);
+    else
+    {
+        U32 x = length - 3;
+        if (x < 8)
+            PutLiteral(bw, 257 + x);
+        else
+        {
+            U32 nb = HighBit(x);
+            PutLiteral(bw, 257 + 4 * (nb - 1) + ((x >> (nb - 2)) & 3));
+            bw.Put(x & ((1 << (nb - 2)) - 1), nb - 2);
+        }
+    }
+
+    // Write the distance code and its extra bits
+    U32 x = distance - 1;
+    if (x < 4)
+        bw.Put(fixed.dist_code[x], 5);
+    else
+    {
+        U32 nb = HighBit(x);
+        bw.Put(fixed.dist_code[2 * nb + ((x >> (nb - 1)) & 1)], 5);
+        bw.Put(x & ((1 << (nb - 1)) - 1), nb - 1);
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Hash() - Hashes the three bytes at "p"
+//=========================================================================================================
+static inline U32 Hash(const U8* p)
+{
+    U32 v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Adler32() - Updates a running Adler-32 checksum with a block of data
+//=========================================================================================================
+U32 Adler32(U32 adler, const U8* data, size_t length)
+{
+    U32 a = adler & 0xFFFF, b = adler >> 16;
+
+    while (length)
+    {
+        // 5552 is the most bytes we can sum before the 32-bit accumulators could overflow
+        size_t n = (length < 5552) ? length : 5552;
+        length -= n;
+        while (n--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+
+    return (b << 16) | a;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Adler32Combine() - Returns the checksum of two adjacent blocks, given the checksum of each
+//=========================================================================================================
+U32 Adler32Combine(U32 adler1, U32 adler2, U64 length2)
+{
+    U32 rem  = (U32)(length2 % ADLER_BASE);
+    U32 sum1 = adler1 & 0xFFFF;
+    U32 sum2 = (U32)(((U64)rem * sum1) % ADLER_BASE);
+
+    sum1 += (adler2 & 0xFFFF) + ADLER_BASE - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - rem;
+
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum2 >= ADLER_BASE * 2) sum2 -= ADLER_BASE * 2;
+    if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+
+    return (sum2 << 16) | sum1;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Store() - Writes a block of data as uncompressed DEFLATE "stored" blocks
+//=========================================================================================================
+static void Store(const U8* data, size_t length, bool final, vector<U8>& out)
+{
+    do
+    {
+        // A stored block can hold at most 65535 bytes
+        U32 n = (length > 65535) ? 65535 : (U32)length;
+        length -= n;
+
+        // The block header: the "final" flag and block-type 0, padded out to a byte boundary
+        out.push_back((final && length == 0) ? 1 : 0);
+
+        // The length of the block and its one's complement
+        out.push_back((U8)(n));
+        out.push_back((U8)(n >> 8));
+        out.push_back((U8)(~n));
+        out.push_back((U8)(~n >> 8));
+
+        // And the data itself
+        out.insert(out.end(), data, data + n);
+        data += n;
+
+    } while (length);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Deflate() - Compresses a block of data into a single fixed-Huffman DEFLATE block.  If the data
+//             doesn't compress, it is stored instead
+//=========================================================================================================
+void Deflate(const U8* data, size_t length, bool final, vector<U8>& out)
+{
+    // Remember where our output begins in case we have to throw it away
+    size_t start = out.size();
+
+    CBitWriter bw(out);
+
+    // For each hash value, the most recent position that hashed to it
+    vector<int> head(HASH_SIZE, -1);
+
+    // For each position in the window, the previous position with the same hash
+    vector<int> prev(WINDOW_SIZE, -1);
+
+    // Write the block header: the "final" flag, then block-type 1 (fixed Huffman codes)
+    bw.Put(final ? 1 : 0, 1);
+    bw.Put(1, 2);
+
+    int pos = 0, end = (int)length;
+
+    while (pos < end)
+    {
+        int best_length = 0, best_distance = 0;
+
+        // If there are enough bytes left to form a match, look for one
+        if (pos + MIN_MATCH <= end)
+        {
+            U32 h = Hash(data + pos);
+
+            // This is the longest match we could possibly find here
+            int max_length = end - pos;
+            if (max_length > MAX_MATCH) max_length = MAX_MATCH;
+
+            // Walk the chain of earlier positions with the same hash
+            int candidate = head[h];
+            for (int chain = MAX_CHAIN; chain && candidate >= 0 && pos - candidate <= WINDOW_SIZE; --chain)
+            {
+                const U8* a = data + candidate;
+                const U8* b = data + pos;
+                int n = 0;
+                while (n < max_length && a[n] == b[n]) ++n;
+
+                if (n > best_length)
+                {
+                    best_length   = n;
+                    best_distance = pos - candidate;
+                    if (n == max_length) break;
+                }
+
+                // Positions along a chain always get older.  If this one doesn't, the slot was reused
+                int next = prev[candidate & (WINDOW_SIZE - 1)];
+                if (next >= candidate) break;
+                candidate = next;
+            }
+
+            // Record this position in the hash chains
+            prev[pos & (WINDOW_SIZE - 1)] = head[h];
+            head[h] = pos;
+        }
+
+        // If we didn't find a match worth using, write a literal byte
+        if (best_length < MIN_MATCH)
+        {
+            PutLiteral(bw, data[pos++]);
+            continue;
+        }
+
+        // Write the match
+        PutMatch(bw, best_length, best_distance);
+
+        // Record the positions we're skipping over in the hash chains
+        int match_end = pos + best_length;
+        for (++pos; pos < match_end; ++pos)
+        {
+            if (pos + MIN_MATCH > end) continue;
+            U32 h = Hash(data + pos);
+            prev[pos & (WINDOW_SIZE - 1)] = head[h];
+            head[h] = pos;
+        }
+    }
+
+    // Write the end-of-block code
+    PutLiteral(bw, 256);
+
+    // If this isn't the final block, follow it with an empty stored block (a "sync flush").  This
+    // leaves the stream on a byte boundary so the next block can be simply appended
+    if (!final)
+    {
+        bw.Put(0, 3);
+        bw.Align();
+        out.push_back(0x00);
+        out.push_back(0x00);
+        out.push_back(0xFF);
+        out.push_back(0xFF);
+    }
+
+    // Make sure that all of our bits have been written
+    bw.Align();
+
+    // If the data got bigger instead of smaller, store it uncompressed instead
+    if (out.size() - start > length + 5 * (length / 65535 + 1))
+    {
+        out.resize(start);
+        Store(data, length, final, out);
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ZlibCompress() - Compresses a block of data into a complete zlib stream
+//=========================================================================================================
+void ZlibCompress(const U8* data, size_t length, vector<U8>& out)
+{
+    // The zlib header: deflate with a 32K window, no preset dictionary, fastest compression
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    // The compressed data
+    Deflate(data, length, true, out);
+
+    // And the big-endian Adler-32 checksum of the uncompressed data
+    U32 adler = Adler32(1, data, length);
+    out.push_back((U8)(adler >> 24));
+    out.push_back((U8)(adler >> 16));
+    out.push_back((U8)(adler >>  8));
+    out.push_back((U8)(adler      ));
+}
+//=========================================================================================================
@@ -0,0 +1,47 @@
+//=========================================================================================================
+// Deflate.h - A small, fast DEFLATE (RFC 1951) compressor and the zlib (RFC 1950) wrapper around it
+//=========================================================================================================
+#pragma once
+#include "typedefs.h"
+#include <vector>
+using std::vector;
+
+//=========================================================================================================
+// Adler32() - Updates a running Adler-32 checksum with a block of data.  Start with "adler" = 1
+//=========================================================================================================
+U32 Adler32(U32 adler, const U8* data, size_t length);
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Adler32Combine() - Given the checksums of two adjacent blocks of data, returns the checksum of the
+//                    combined block.  "length2" is the length of the second block
+//=========================================================================================================
+U32 Adler32Combine(U32 adler1, U32 adler2, U64 length2);
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Deflate() - Compresses a block of data and appends it to "out" as a self-contained piece of a DEFLATE
+//             stream.  If "final" is false, the output ends with a sync-flush marker, so independently
+//             compressed blocks can be concatenated into a single valid stream as long as only the last
+//             one is marked final.
+//=========================================================================================================
+void Deflate(const U8* data, size_t length, bool final, vector<U8>& out);
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ZlibCompress() - Compresses a block of data into a complete zlib stream (header, data, checksum) and
+//                  appends it to "out"
+//=========================================================================================================
+void ZlibCompress(const U8* data, size_t length, vector<U8>& out);
+//=========================================================================================================
+
+
+//=========================================================================================================
+// These are the bytes that end a DEFLATE stream whose blocks were all compressed with "final" = false.
+// They are an empty, final, fixed-Huffman block
+//=========================================================================================================
+const U8 DEFLATE_END[2] = {0x03, 0x00};
+//=========================================================================================================
@@ -0,0 +1,327 @@
+//=========================================================================================================
+// DziWriter.cpp - Writes rendered images as Deep Zoom tile pyramids, one panel at a time
+//
+// In a Deep Zoom pyramid, the highest-numbered level is the full-resolution image.  Each level below it
+// is half the width and height of the level above (rounded up), and level 0 is a single pixel.  Every
+// level is cut into tiles, and the tiles are stored as individual image files.
+//=========================================================================================================
+#include "stdafx.h"
+#include <shellapi.h>
+#include "DziWriter.h"
+#include "Globals.h"
+
+
+//=========================================================================================================
+// TileKey() - Returns the key that identifies a tile in our map of partially complete tiles
+//=========================================================================================================
+static U64 TileKey(U32 level, U32 x, U32 y)
+{
+    return ((U64)level << 48) | ((U64)y << 24) | x;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// LevelSize() - Returns the width or height of the image on the specified level, given its width or
+//               height at full resolution
+//=========================================================================================================
+U32 CDziWriter::LevelSize(U32 size, U32 level)
+{
+    U32 shift = m_max_level - level;
+    return (U32)(((U64)size + ((U64)1 << shift) - 1) >> shift);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Create() - Creates the directory that will hold the tiles, and a sub-directory for every level
+//=========================================================================================================
+bool CDziWriter::Create(CString fn, U32 cols, U32 rows)
+{
+    CString dir;
+
+    // Make sure any pyramid we were previously writing is finished
+    Close();
+
+    // Keep track of the image dimensions
+    m_cols = cols;
+    m_rows = rows;
+
+    // Find the full-resolution level.  It's the first one where a single pixel can cover the image
+    U32 size = (cols > rows) ? cols : rows;
+    for (m_max_level = 0; ((U64)1 << m_max_level) < size; ++m_max_level);
+
+    // The tiles for "render.dzi" go into a directory named "render_files"
+    int dot = fn.ReverseFind('.');
+    m_fn  = fn;
+    m_dir = ((dot < 0) ? fn : fn.Left(dot)) + L"_files";
+
+    // Get rid of the tiles from any previous pyramid with the same name
+    DeleteTiles();
+
+    // Create the directory for the tiles and one sub-directory for each level
+    if (!CreateDirectory(m_dir, nullptr)) return false;
+    for (U32 level=0; level<=m_max_level; ++level)
+    {
+        dir.Format(L"%s\\%u", (const wchar_t*)m_dir, level);
+        if (!CreateDirectory(dir, nullptr))
+        {
+            DeleteTiles();
+            return false;
+        }
+    }
+
+    // We're ready to accept panels
+    m_is_open  = true;
+    m_ok       = true;
+    m_complete = false;
+
+    // Tell the caller that all is well
+    return true;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// EncodeItem() - Called by an encoder thread to write one tile of the current batch, and to create a
+//                half-size copy of it for its parent tile
+//=========================================================================================================
+void CDziWriter::EncodeItem(U32 item, U32 thread)
+{
+    CString fn;
+
+    // Get a reference to the tile we're writing
+    tile& t = m_batch[item];
+
+    // Write the tile to its own file
+    fn.Format(L"%s\\%u\\%u_%u.png", (const wchar_t*)m_dir, t.level, t.x, t.y);
+    if (!WritePng(fn, t.bitmap, t.cols, t.rows, t.stride)) m_ok = false;
+
+    // The tile on level 0 has no parent
+    if (t.level == 0) return;
+
+    // Determine the size of the shrunken tile
+    U32 half_cols = (t.cols + 1) / 2;
+    U32 half_rows = (t.rows + 1) / 2;
+    t.half.resize(half_cols * half_rows);
+
+    // Each pixel of the shrunken tile is the average of the 2x2 block of pixels it covers.  At the right
+    // and bottom edges of the image the block may be only partially filled
+    pixel* out = t.half.data();
+    for (U32 y=0; y<half_rows; ++y)
+    {
+        U32 y0 = 2 * y, y1 = (y0 + 1 < t.rows) ? y0 + 1 : y0;
+
+        for (U32 x=0; x<half_cols; ++x)
+        {
+            U32 x0 = 2 * x, x1 = (x0 + 1 < t.cols) ? x0 + 1 : x0;
+
+            // Point to the four pixels in the block.  Where the block is partially filled, some of them
+            // will be the same pixel
+            pixel* p[4] =
+            {
+                t.bitmap + y0 * t.stride + x0, t.bitmap + y0 * t.stride + x1,
+                t.bitmap + y1 * t.stride + x0, t.bitmap + y1 * t.stride + x1
+            };
+
+            // Average them, rounding to the nearest value
+            out->r = (p[0]->r + p[1]->r + p[2]->r + p[3]->r + 2) / 4;
+            out->g = (p[0]->g + p[1]->g + p[2]->g + p[3]->g + 2) / 4;
+            out->b = (p[0]->b + p[1]->b + p[2]->b + p[3]->b + 2) / 4;
+            out->a = 0;
+            ++out;
+        }
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WriteBatch() - Has the encoder threads write every tile in the current batch.  Then each tile's shrunken
+//                copy is moved into its parent, and any parents that are now complete become the next
+//                batch.  This repeats until a batch completes no parents.
+//=========================================================================================================
+bool CDziWriter::WriteBatch()
+{
+    vector<tile> next;
+    const U32 half_tile = DZI_TILE_SIZE / 2;
+
+    while (!m_batch.empty())
+    {
+        // Write every tile in the batch and create their shrunken copies
+        CEncoder::StartJob(this, (U32)m_batch.size());
+        CEncoder::WaitForJob();
+
+        // Loop through each tile we just wrote...
+        for (auto it = m_batch.begin(); it != m_batch.end(); ++it)
+        {
+            // The tile on level 0 has no parent.  Once it has been written, the pyramid is complete
+            if (it->level == 0)
+            {
+                m_complete = true;
+                continue;
+            }
+
+            // Find the parent of this tile
+            U32 level = it->level - 1;
+            U32 px    = it->x / 2;
+            U32 py    = it->y / 2;
+
+            // Find the parent in our list of partially complete tiles, creating it if it's not there
+            partial_tile& parent = m_partial[TileKey(level, px, py)];
+            if (parent.buffer.empty())
+            {
+                parent.buffer.resize(DZI_TILE_SIZE * DZI_TILE_SIZE);
+                parent.children = 0;
+            }
+
+            // Copy the shrunken tile into the correct quarter of its parent
+            U32 half_cols = (it->cols + 1) / 2;
+            U32 half_rows = (it->rows + 1) / 2;
+            pixel* out = parent.buffer.data() + (it->y & 1) * half_tile * DZI_TILE_SIZE + (it->x & 1) * half_tile;
+            for (U32 y=0; y<half_rows; ++y)
+            {
+                memcpy(out + y * DZI_TILE_SIZE, it->half.data() + y * half_cols, half_cols * sizeof(pixel));
+            }
+
+            // Find out how many tiles there are across and down the level that this tile lives on
+            U32 tiles_across = (LevelSize(m_cols, it->level) + DZI_TILE_SIZE - 1) / DZI_TILE_SIZE;
+            U32 tiles_down   = (LevelSize(m_rows, it->level) + DZI_TILE_SIZE - 1) / DZI_TILE_SIZE;
+
+            // At the right and bottom edges, a parent may have fewer than four children
+            U32 children_across = (tiles_across - 2 * px > 1) ? 2 : 1;
+            U32 children_down   = (tiles_down   - 2 * py > 1) ? 2 : 1;
+
+            // If the parent hasn't received all of its children yet, we're done with this tile
+            if (++parent.children < children_across * children_down) continue;
+
+            // Otherwise the parent is ready to be written in the next batch
+            tile t;
+            t.level  = level;
+            t.x      = px;
+            t.y      = py;
+            t.cols   = LevelSize(m_cols, level) - px * DZI_TILE_SIZE;
+            t.rows   = LevelSize(m_rows, level) - py * DZI_TILE_SIZE;
+            t.stride = DZI_TILE_SIZE;
+            if (t.cols > DZI_TILE_SIZE) t.cols = DZI_TILE_SIZE;
+            if (t.rows > DZI_TILE_SIZE) t.rows = DZI_TILE_SIZE;
+            next.push_back(t);
+            next.back().buffer.swap(parent.buffer);
+            next.back().bitmap = next.back().buffer.data();
+
+            // And it's no longer partially complete
+            m_partial.erase(TileKey(level, px, py));
+        }
+
+        // The parents that we completed are the next batch of tiles to write
+        m_batch.swap(next);
+        next.clear();
+    }
+
+    // Tell the caller whether all of the tiles were written
+    return m_ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WritePanel() - Writes the full-resolution tiles of a panel, and any lower-resolution tiles that they
+//                complete
+//=========================================================================================================
+bool CDziWriter::WritePanel(pixel* bitmap, U32 left, U32 top, U32 cols, U32 rows)
+{
+    tile t;
+
+    // If we're not writing a pyramid, we can't write anything
+    if (!m_is_open) return false;
+
+    // Make a batch out of every tile in this panel
+    m_batch.clear();
+    for (U32 y=0; y<rows; y += DZI_TILE_SIZE)
+    {
+        for (U32 x=0; x<cols; x += DZI_TILE_SIZE)
+        {
+            t.level  = m_max_level;
+            t.x      = (left + x) / DZI_TILE_SIZE;
+            t.y      = (top  + y) / DZI_TILE_SIZE;
+            t.cols   = (cols - x > DZI_TILE_SIZE) ? DZI_TILE_SIZE : cols - x;
+            t.rows   = (rows - y > DZI_TILE_SIZE) ? DZI_TILE_SIZE : rows - y;
+            t.bitmap = bitmap + (U64)y * cols + x;
+            t.stride = cols;
+            m_batch.push_back(t);
+        }
+    }
+
+    // And write them
+    return WriteBatch();
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// DeleteTiles() - Deletes the directory of tiles and everything in it
+//=========================================================================================================
+void CDziWriter::DeleteTiles()
+{
+    SHFILEOPSTRUCT op;
+
+    // The list of names to delete must end with an extra null character
+    vector<wchar_t> from(m_dir.GetLength() + 2, 0);
+    memcpy(from.data(), (const wchar_t*)m_dir, m_dir.GetLength() * sizeof(wchar_t));
+
+    // Delete the directory without asking the user anything
+    memset(&op, 0, sizeof op);
+    op.wFunc  = FO_DELETE;
+    op.pFrom  = from.data();
+    op.fFlags = FOF_NO_UI;
+    SHFileOperation(&op);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Close() - Writes the DZI descriptor that tells a viewer how the pyramid is laid out, or deletes the
+//           pyramid if it is incomplete or we've been asked to
+//=========================================================================================================
+bool CDziWriter::Close(bool erase)
+{
+    FILE* ofile;
+    bool  ok = true;
+
+    // If we're not writing a pyramid, there's nothing to do
+    if (!m_is_open) return true;
+    m_is_open = false;
+
+    // If any tile couldn't be written or hasn't been written yet, the pyramid is incomplete
+    if (!erase && (!m_ok || !m_complete)) {erase = true; ok = false;}
+
+    // If we're keeping the pyramid, write the descriptor
+    if (!erase)
+    {
+        if (_wfopen_s(&ofile, m_fn, L"w") == 0)
+        {
+            fprintf(ofile, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+            fprintf(ofile, "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\"\n");
+            fprintf(ofile, "       Format=\"png\" Overlap=\"0\" TileSize=\"%u\">\n", DZI_TILE_SIZE);
+            fprintf(ofile, "    <Size Width=\"%u\" Height=\"%u\"/>\n", m_cols, m_rows);
+            fprintf(ofile, "</Image>\n");
+            if (fclose(ofile) != 0) {erase = true; ok = false;}
+        }
+        else {erase = true; ok = false;}
+    }
+
+    // If we've been asked to (or couldn't finish the pyramid), delete it
+    if (erase)
+    {
+        DeleteTiles();
+        DeleteFile(m_fn);
+    }
+
+    // Free our buffers
+    m_batch.clear();
+    m_partial.clear();
+
+    // Tell the caller whether the pyramid was completely written
+    return ok;
+}
+//=========================================================================================================
@@ -0,0 +1,100 @@
+//=========================================================================================================
+// DziWriter.h - Describes the class that writes rendered images as Deep Zoom tile pyramids
+//=========================================================================================================
+#pragma once
+#include "Image.h"
+#include "Encoder.h"
+#include <map>
+using std::map;
+
+// The width and height (in pixels) of a tile in the pyramid
+#define DZI_TILE_SIZE 256
+
+//=========================================================================================================
+// CDziWriter - Writes panels of pixels into a Deep Zoom Image (DZI) tile pyramid.  For an output file
+//              named "render.dzi", the tiles are written as "render_files\<level>\<column>_<row>.png".
+//
+//              Every panel must start on a tile boundary, and must be a whole number of tiles wide and
+//              tall unless it reaches the right or bottom edge of the image.  The full-resolution tiles
+//              of each panel are written as soon as the panel arrives.  Each tile is also shrunk by half
+//              and stored in one quarter of its parent tile on the level below.  When a parent tile has
+//              received all of its children, it is written and shrunk in turn.  Only parent tiles that
+//              are still waiting for children are kept in memory.
+//=========================================================================================================
+class CDziWriter : public CImageWriter, public CEncodeJob
+{
+public:
+
+    // Default constructor
+    CDziWriter() {m_is_open = false;}
+
+    // Destructor finishes the pyramid if it's still open
+    ~CDziWriter() {Close();}
+
+    // Creates the directory that will hold the tiles
+    bool    Create(CString fn, U32 cols, U32 rows);
+
+    // Writes the tiles of a panel, and any lower-resolution tiles that it completes
+    bool    WritePanel(pixel* bitmap, U32 left, U32 top, U32 cols, U32 rows);
+
+    // Writes the DZI descriptor, or optionally deletes the whole pyramid.  Returns false if the
+    // pyramid couldn't be completely written
+    bool    Close(bool erase = false);
+
+    // Called by the encoder threads to write and shrink one tile
+    void    EncodeItem(U32 item, U32 thread);
+
+protected:
+
+    // A tile that is ready to be written
+    struct tile
+    {
+        U32           level, x, y;
+        U32           cols, rows;
+        pixel*        bitmap;
+        U32           stride;
+        vector<pixel> buffer;
+        vector<pixel> half;
+    };
+
+    // A tile on a lower level that is still waiting for some of its children
+    struct partial_tile
+    {
+        vector<pixel> buffer;
+        U32           children;
+    };
+
+    // Returns the width or height of the image on the specified level
+    U32     LevelSize(U32 size, U32 level);
+
+    // Writes a batch of tiles, then moves their shrunken versions into their parents
+    bool    WriteBatch();
+
+    // Deletes the directory of tiles
+    void    DeleteTiles();
+
+    // The name of the descriptor file, and of the directory that holds the tiles
+    CString m_fn;
+    CString m_dir;
+
+    // This is true while a pyramid is being written
+    bool    m_is_open;
+
+    // Dimensions of the complete image, and the number of the full-resolution level
+    U32     m_cols;
+    U32     m_rows;
+    U32     m_max_level;
+
+    // This will be false if any tile couldn't be written
+    volatile bool m_ok;
+
+    // This will be true once the single tile on level 0 has been written
+    bool    m_complete;
+
+    // The tiles currently being written by the encoder threads
+    vector<tile> m_batch;
+
+    // Lower-level tiles still waiting for children, keyed by level, then row, then column
+    map<U64, partial_tile> m_partial;
+};
+//=========================================================================================================
@@ -0,0 +1,130 @@
+//=========================================================================================================
+// Encoder.cpp - A pool of threads that encode (pack, compress, etc) output data in parallel
+//=========================================================================================================
+#include "stdafx.h"
+#include "Encoder.h"
+#include "Globals.h"
+
+
+//=========================================================================================================
+// Variables common to all instances of this class
+//=========================================================================================================
+CEncodeJob*   CEncoder::m_job;
+U32           CEncoder::m_item_count;
+volatile U32  CEncoder::m_next_item;
+vector<char>  CEncoder::m_item_done;
+CCriticalSection   CEncoder::m_cs;
+CONDITION_VARIABLE CEncoder::m_item_cv = CONDITION_VARIABLE_INIT;
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Init() - Initialize the thread
+//=========================================================================================================
+void CEncoder::Init()
+{
+    CreatePipe(&m_hread_cmd, &m_hwrite_cmd, NULL, 0);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// StartJob() - Starts all of the encoder threads working on a job.  The caller must wait for the job
+//              to finish before starting another one
+//=========================================================================================================
+void CEncoder::StartJob(CEncodeJob* job, U32 item_count)
+{
+    char command = 0;
+
+    // Encoder threads that finished the last job may still be asking for items, so the new job is set
+    // up while they're locked out
+    m_cs.Lock();
+
+    // Record the job and how many items it has
+    m_job        = job;
+    m_item_count = item_count;
+    m_next_item  = 0;
+
+    // None of the items have been encoded yet
+    m_item_done.assign(item_count, 0);
+
+    m_cs.Unlock();
+
+    // And wake up all of the encoder threads
+    for (U32 i=0; i<cpu_count; ++i) WriteFile(Encoder[i].m_hwrite_cmd, &command, 1, nullptr, nullptr);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WaitForItem() - Waits for the specified item of the current job to be encoded
+//=========================================================================================================
+void CEncoder::WaitForItem(U32 item)
+{
+    // The flag is only set while the lock is held, so it can't get set between checking it and waiting
+    m_cs.Lock();
+    while (!m_item_done[item]) SleepConditionVariableCS(&m_item_cv, &m_cs.m_sect, INFINITE);
+    m_cs.Unlock();
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WaitForJob() - Waits for every item of the current job to be encoded
+//=========================================================================================================
+void CEncoder::WaitForJob()
+{
+    for (U32 item=0; item<m_item_count; ++item) WaitForItem(item);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// IssueItem() - Returns the number of the next item that needs to be encoded, or -1 if there are none
+//=========================================================================================================
+int CEncoder::IssueItem()
+{
+    // Assume for the moment that we are out of items
+    int result = -1;
+
+    // Only one thread at a time is allowed to request a new item
+    m_cs.Lock();
+
+    // If there is an item available, it's our result
+    if (m_next_item < m_item_count) result = m_next_item++;
+
+    // Allow other threads to run this routine
+    m_cs.Unlock();
+
+    // Hand the caller his item number
+    return result;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Main() - Encodes items of whatever job we're handed
+//=========================================================================================================
+void CEncoder::Main(int P1, int P2, int P3)
+{
+    char command;
+
+    while (true)
+    {
+        // Wait for a new job to arrive
+        ReadFile(m_hread_cmd, &command, 1, nullptr, nullptr);
+
+        // Keep encoding items until there are none left
+        for (int item = IssueItem(); item >= 0; item = IssueItem())
+        {
+            m_job->EncodeItem(item, m_ID);
+
+            // Mark the item as done, and wake up anyone waiting for it
+            m_cs.Lock();
+            m_item_done[item] = 1;
+            m_cs.Unlock();
+            WakeAllConditionVariable(&m_item_cv);
+        }
+    }
+}
+//=========================================================================================================
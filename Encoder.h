@@ -0,0 +1,68 @@
+#pragma once
+#include "CThread.h"
+#include "typedefs.h"
+#include <vector>
+using std::vector;
+
+//=========================================================================================================
+// CEncodeJob - A job that is split into independent items (tiles, strips of rows, etc) that can be
+//              encoded in parallel by the encoder threads
+//=========================================================================================================
+class CEncodeJob
+{
+public:
+
+    // Called by encoder thread "thread" to encode item number "item"
+    virtual void EncodeItem(U32 item, U32 thread) = 0;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CEncoder - This is the class/thread that encodes items of a CEncodeJob.  All encoder threads work on
+//            the same job at the same time, each one fetching the next un-encoded item until there are
+//            none left.
+//=========================================================================================================
+class CEncoder : public CThread
+{
+public:
+
+    // Starts all of the encoder threads working on a job
+    static void StartJob(CEncodeJob* job, U32 item_count);
+
+    // Waits for the specified item of the current job to be encoded
+    static void WaitForItem(U32 item);
+
+    // Waits for every item of the current job to be encoded
+    static void WaitForJob();
+
+    // Initialize this encoder thread
+    void Init();
+
+    // This routine is called when this thread spawns
+    void Main(int P1, int P2, int P3);
+
+protected:
+
+    static int  IssueItem();
+
+    // The job that is currently being encoded
+    static CEncodeJob*  m_job;
+
+    // The number of items in that job, and the next one to be issued to an encoder thread
+    static U32          m_item_count;
+    volatile static U32 m_next_item;
+
+    // One entry per item, set to non-zero when the item has been encoded
+    static vector<char> m_item_done;
+
+    // This guards the job, its items, and their "done" flags.  Encoder threads from the previous job may
+    // still be looking for work when the next job starts, so they must never see it half set up
+    static CCriticalSection   m_cs;
+
+    // This is woken every time any item finishes encoding
+    static CONDITION_VARIABLE m_item_cv;
+
+    HANDLE  m_hread_cmd, m_hwrite_cmd;
+};
+//=========================================================================================================
@@ -0,0 +1,339 @@
+//=========================================================================================================
+// EscapeCodec.cpp - A lossless compressor for tiles of escape data
+//
+// A compressed tile is a single method byte followed by the data:
+//
+//     0 = Stored.  The samples, row after row, exactly as they are in memory
+//     1 = Rice.    A bit stream (most significant bit first) holding one Rice code per 32-bit value
+//
+// Each sample is two 32-bit values (the iteration count and the bit pattern of the distance), so a pixel
+// is 2 * spp values.  Every value is predicted from the same value of the neighboring pixels, and the
+// difference is mapped to an unsigned number (0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...) and Rice coded
+// with a parameter "k" that adapts to the recent size of the differences.  A Rice code is the number
+// shifted right by k, in unary (that many 0 bits followed by a 1 bit), then the low k bits of the number.
+// Differences too large for a short unary code are escaped and stored as a raw 32-bit value.
+//=========================================================================================================
+#include "stdafx.h"
+#include "EscapeCodec.h"
+#include <intrin.h>
+
+// The compression methods
+enum {METHOD_STORED, METHOD_RICE};
+
+// A unary code this long (all 0 bits) means that a raw 32-bit value follows
+static const U32 RICE_LIMIT = 24;
+
+
+//=========================================================================================================
+// rice_context - Tracks the recent size of the differences, to choose the Rice parameter
+//=========================================================================================================
+struct rice_context
+{
+    U64 total;
+    U32 count;
+    U32 k;
+
+    // Start out assuming small differences
+    rice_context() {total = 16; count = 1; k = 4;}
+
+    // Records the size of a difference, and adjusts the Rice parameter so that "count << k" is the
+    // smallest that is at least "total".  Older differences gradually count for less
+    void Update(U32 value)
+    {
+        total += value;
+        if (++count == 64)
+        {
+            total >>= 1;
+            count >>= 1;
+        }
+        while (((U64)count << k) < total && k < 31) ++k;
+        while (k && ((U64)count << (k - 1)) >= total) --k;
+    }
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CBitWriter - Appends a stream of bits to a byte buffer, most significant bit first
+//=========================================================================================================
+class CBitWriter
+{
+public:
+
+    CBitWriter(vector<U8>& out) : m_out(out) {m_bits = 0; m_count = 0;}
+
+    // Writes the low "bits" bits of "value" (up to 32 of them)
+    void Put(U32 value, U32 bits)
+    {
+        m_bits   = (m_bits << bits) | value;
+        m_count += bits;
+        while (m_count >= 8)
+        {
+            m_count -= 8;
+            m_out.push_back((U8)(m_bits >> m_count));
+        }
+    }
+
+    // Pads the stream out to a whole number of bytes
+    void Flush() {if (m_count) Put(0, 8 - m_count);}
+
+protected:
+
+    vector<U8>& m_out;
+    U64         m_bits;
+    U32         m_count;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CBitReader - Reads a stream of bits written by CBitWriter.  Reading past the end of the data returns 0
+//              bits, and is detected afterwards by "Overrun()"
+//=========================================================================================================
+class CBitReader
+{
+public:
+
+    CBitReader(const U8* data, size_t length)
+    {
+        m_ptr     = data;
+        m_end     = data + length;
+        m_length  = length;
+        m_loaded  = 0;
+        m_bits    = 0;
+        m_count   = 0;
+    }
+
+    // Makes sure there are at least 57 bits in the buffer, aligned to its top bit
+    void Fill()
+    {
+        while (m_count <= 56)
+        {
+            U64 byte = (m_ptr < m_end) ? *m_ptr++ : 0;
+            m_bits  |= byte << (56 - m_count);
+            m_count += 8;
+            ++m_loaded;
+        }
+    }
+
+    // Reads a value that is "bits" bits long (up to 32 bits)
+    U32 Get(U32 bits)
+    {
+        if (bits == 0) return 0;
+        Fill();
+        U32 value = (U32)(m_bits >> (64 - bits));
+        m_bits  <<= bits;
+        m_count  -= bits;
+        return value;
+    }
+
+    // Reads a unary code.  Returns RICE_LIMIT if the code is an escape
+    U32 GetUnary()
+    {
+        unsigned long top;
+
+        Fill();
+
+        // If the next RICE_LIMIT bits are all zero, this is an escape
+        if ((m_bits >> (64 - RICE_LIMIT)) == 0)
+        {
+            m_bits  <<= RICE_LIMIT;
+            m_count  -= RICE_LIMIT;
+            return RICE_LIMIT;
+        }
+
+        // Otherwise, count the 0 bits in front of the first 1 bit, and consume them all
+        _BitScanReverse64(&top, m_bits);
+        U32 zeros = 63 - top;
+        m_bits  <<= zeros + 1;
+        m_count  -= zeros + 1;
+        return zeros;
+    }
+
+    // Returns true if we have read more bits than the data contains
+    bool Overrun() {return (m_loaded * 8 - m_count) > (U64)m_length * 8;}
+
+protected:
+
+    const U8*   m_ptr;
+    const U8*   m_end;
+    size_t      m_length;
+    U64         m_loaded;
+    U64         m_bits;
+    U32         m_count;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Predict() - Predicts a value from the values to its left (a), above it (b), and above-left (c).  This
+//             picks the smaller of a and b when c suggests a rising edge, the larger when it suggests a
+//             falling edge, and otherwise assumes a smooth gradient
+//=========================================================================================================
+static inline U32 Predict(U32 a, U32 b, U32 c)
+{
+    U32 lo = (a < b) ? a : b;
+    U32 hi = (a < b) ? b : a;
+    if (c >= hi) return lo;
+    if (c <= lo) return hi;
+    return a + b - c;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// PredictAt() - Predicts value "w" of pixel "x" of a row, given the row and the row above it (which is
+//               nullptr for the first row).  "W" is the number of values per pixel
+//=========================================================================================================
+static inline U32 PredictAt(const U32* row, const U32* above, U32 x, U32 w, U32 W)
+{
+    if (above == nullptr) return (x == 0) ? 0 : row[(x - 1) * W + w];
+    if (x == 0) return above[w];
+    return Predict(row[(x - 1) * W + w], above[x * W + w], above[(x - 1) * W + w]);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// EncodeEscapeTile() - Compresses a block of samples and appends it to "out"
+//=========================================================================================================
+void EncodeEscapeTile(const escape_sample* samples, U32 stride, U32 cols, U32 rows, U32 spp, vector<U8>& out)
+{
+    rice_context context[2];
+
+    // Each pixel is this many 32-bit values
+    const U32 W = spp * 2;
+
+    // The samples are treated as 32-bit values
+    const U32* values = (const U32*)samples;
+
+    // Remember where this tile starts in the output buffer
+    size_t start = out.size();
+
+    // Assume for the moment that Rice coding is going to save space
+    out.push_back(METHOD_RICE);
+
+    CBitWriter writer(out);
+
+    // Loop through each value of each pixel of each row...
+    for (U32 y=0; y<rows; ++y)
+    {
+        const U32* row   = values + (U64)y * stride * W;
+        const U32* above = y ? row - (U64)stride * W : nullptr;
+
+        for (U32 x=0; x<cols; ++x)
+        {
+            for (U32 w=0; w<W; ++w)
+            {
+                // Find the difference between this value and its prediction
+                int diff = (int)(row[x * W + w] - PredictAt(row, above, x, w, W));
+
+                // Map it to an unsigned number that's small when the difference is small
+                U32 mapped = ((U32)diff << 1) ^ (U32)(diff >> 31);
+
+                // Iteration counts and distances each have their own Rice parameter
+                rice_context& rc = context[w & 1];
+                U32 k = rc.k;
+
+                // Write the Rice code, or an escape followed by the raw value
+                U32 q = mapped >> k;
+                if (q < RICE_LIMIT)
+                {
+                    writer.Put(1, q + 1);
+                    if (k) writer.Put(mapped & ((1u << k) - 1), k);
+                }
+                else
+                {
+                    writer.Put(0, RICE_LIMIT);
+                    writer.Put(mapped, 32);
+                }
+
+                rc.Update(mapped);
+            }
+        }
+    }
+
+    writer.Flush();
+
+    // If Rice coding didn't save any space, store the samples instead
+    U64 raw_size = (U64)cols * rows * W * sizeof(U32);
+    if (out.size() - start - 1 > raw_size)
+    {
+        out.resize(start);
+        out.push_back(METHOD_STORED);
+        for (U32 y=0; y<rows; ++y)
+        {
+            const U8* row = (const U8*)(values + (U64)y * stride * W);
+            out.insert(out.end(), row, row + cols * W * sizeof(U32));
+        }
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// DecodeEscapeTile() - Decompresses a block of samples that was compressed by "EncodeEscapeTile()"
+//=========================================================================================================
+bool DecodeEscapeTile(const U8* data, size_t length, escape_sample* samples, U32 stride, U32 cols, U32 rows, U32 spp)
+{
+    rice_context context[2];
+
+    // Each pixel is this many 32-bit values
+    const U32 W = spp * 2;
+
+    // The samples are treated as 32-bit values
+    U32* values = (U32*)samples;
+
+    // There must at least be a method byte
+    if (length == 0) return false;
+
+    // If the samples were stored, just copy them
+    if (data[0] == METHOD_STORED)
+    {
+        size_t row_bytes = (size_t)cols * W * sizeof(U32);
+        if (length - 1 != row_bytes * rows) return false;
+        for (U32 y=0; y<rows; ++y)
+        {
+            memcpy(values + (U64)y * stride * W, data + 1 + y * row_bytes, row_bytes);
+        }
+        return true;
+    }
+
+    // Otherwise, it had better be Rice coded
+    if (data[0] != METHOD_RICE) return false;
+
+    CBitReader reader(data + 1, length - 1);
+
+    // Loop through each value of each pixel of each row...
+    for (U32 y=0; y<rows; ++y)
+    {
+        U32*       row   = values + (U64)y * stride * W;
+        const U32* above = y ? row - (U64)stride * W : nullptr;
+
+        for (U32 x=0; x<cols; ++x)
+        {
+            for (U32 w=0; w<W; ++w)
+            {
+                rice_context& rc = context[w & 1];
+                U32 k = rc.k;
+
+                // Read the Rice code, or the raw value that follows an escape
+                U32 mapped, q = reader.GetUnary();
+                if (q < RICE_LIMIT)
+                    mapped = (q << k) | reader.Get(k);
+                else
+                    mapped = reader.Get(32);
+
+                rc.Update(mapped);
+
+                // Turn it back into a difference, and add the prediction
+                U32 diff = (mapped >> 1) ^ (0 - (mapped & 1));
+                row[x * W + w] = PredictAt(row, above, x, w, W) + diff;
+            }
+        }
+    }
+
+    // Tell the caller whether the data held everything we read
+    return !reader.Overrun();
+}
+//=========================================================================================================
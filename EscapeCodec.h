@@ -0,0 +1,32 @@
+//=========================================================================================================
+// EscapeCodec.h - A lossless compressor for tiles of escape data
+//
+// Neighboring samples of an iteration map have nearly the same values, so each value is predicted from
+// the values to its left, above it, and above-left (the "median edge detector" predictor used by
+// LOCO-I / JPEG-LS), and only the difference is stored.  The differences are small and cluster around
+// zero, so they are written with an adaptive Rice code.  Iteration counts and distances are predicted
+// separately, from the same sample of the neighboring pixels.  A distance is predicted from the bit
+// pattern of the float, which (for positive floats) increases with its value.
+//
+// Every tile is compressed on its own, so any tile can be decoded without reading any other.
+//=========================================================================================================
+#pragma once
+#include "typedefs.h"
+#include "EscapeFile.h"
+#include <vector>
+using std::vector;
+
+//=========================================================================================================
+// EncodeEscapeTile() - Compresses a block of samples and appends it to "out".  "stride" is the distance
+//                      in pixels from one row of the block to the next
+//=========================================================================================================
+void EncodeEscapeTile(const escape_sample* samples, U32 stride, U32 cols, U32 rows, U32 spp, vector<U8>& out);
+//=========================================================================================================
+
+
+//=========================================================================================================
+// DecodeEscapeTile() - Decompresses a block of samples that was compressed by "EncodeEscapeTile()".
+//                      Returns false if the compressed data is damaged
+//=========================================================================================================
+bool DecodeEscapeTile(const U8* data, size_t length, escape_sample* samples, U32 stride, U32 cols, U32 rows, U32 spp);
+//=========================================================================================================
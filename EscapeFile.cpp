@@ -0,0 +1,303 @@
+//=========================================================================================================
+// EscapeFile.cpp - Writes and reads escape-data files
+//=========================================================================================================
+#include "stdafx.h"
+#include "EscapeFile.h"
+#include "EscapeCodec.h"
+#include "Globals.h"
+
+// The signature at the front of every escape-data file
+static const char ESCAPE_MAGIC[8] = {'F', 'G', 'E', 'S', 'C', 'A', 'P', 'E'};
+
+// The version of the file layout that we write
+static const U32 ESCAPE_VERSION = 2;
+
+
+//=========================================================================================================
+// Create() - Creates the output file and reserves room for the header
+//=========================================================================================================
+bool CEscapeWriter::Create(CString fn, U32 cols, U32 rows, U32 samples_per_pixel)
+{
+    vector<U8> header(ESCAPE_HDR_SIZE, 0);
+
+    // Make sure any file we previously had open is closed
+    Close();
+
+    // Create and open the output file
+    if (!m_file.Create(fn)) return false;
+
+    // Fill in the header
+    memset(&m_hdr, 0, sizeof m_hdr);
+    memcpy(m_hdr.magic, ESCAPE_MAGIC, sizeof m_hdr.magic);
+    m_hdr.version           = ESCAPE_VERSION;
+    m_hdr.hdr_size          = ESCAPE_HDR_SIZE;
+    m_hdr.cols              = cols;
+    m_hdr.rows              = rows;
+    m_hdr.samples_per_pixel = samples_per_pixel;
+    m_hdr.tile_size         = ESCAPE_TILE_SIZE;
+    m_hdr.tiles_across      = (cols + ESCAPE_TILE_SIZE - 1) / ESCAPE_TILE_SIZE;
+    m_hdr.tiles_down        = (rows + ESCAPE_TILE_SIZE - 1) / ESCAPE_TILE_SIZE;
+
+    // Record how the image was computed
+    m_hdr.dwell             = dwell;
+    m_hdr.center_real       = ps.coord.center.real;
+    m_hdr.center_imag       = ps.coord.center.imag;
+    m_hdr.span_real         = ps.coord.span.real;
+    m_hdr.span_imag         = ps.coord.span.imag;
+
+    // None of the tiles have been written yet
+    m_index.assign((size_t)m_hdr.tiles_across * m_hdr.tiles_down, escape_tile_entry());
+
+    // Reserve room for the header.  It's written for real once we know where the index is
+    if (!m_file.Write(header.data(), header.size()))
+    {
+        Close(true);
+        return false;
+    }
+
+    // Tell the caller that all is well
+    return true;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// EncodeItem() - Called by encoder thread "thread" to compress tile number "item" of the current panel
+//=========================================================================================================
+void CEscapeWriter::EncodeItem(U32 item, U32 thread)
+{
+    tile& t = m_tile[item];
+
+    // Point to the first sample of this tile within the panel
+    escape_sample* p_sample = m_samples + ((U64)(t.y * ESCAPE_TILE_SIZE - m_panel_top) * m_panel_cols
+                                        + (t.x * ESCAPE_TILE_SIZE - m_panel_left)) * m_hdr.samples_per_pixel;
+
+    // Compress the tile
+    t.packed.clear();
+    EncodeEscapeTile(p_sample, m_panel_cols, t.cols, t.rows, m_hdr.samples_per_pixel, t.packed);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WritePanel() - Compresses each tile of a panel and appends it to the file
+//=========================================================================================================
+bool CEscapeWriter::WritePanel(escape_sample* samples, U32 left, U32 top, U32 cols, U32 rows)
+{
+    const U32 T = ESCAPE_TILE_SIZE;
+    bool ok = true;
+
+    // If the output file isn't open, we can't write anything
+    if (!m_file.IsOpen()) return false;
+
+    // The panel has to start on a tile boundary
+    if (left % T || top % T) return false;
+
+    // Record the panel we're about to compress
+    m_samples    = samples;
+    m_panel_left = left;
+    m_panel_top  = top;
+    m_panel_cols = cols;
+
+    // Make a list of every tile in this panel
+    m_tile.clear();
+    for (U32 y=0; y<rows; y += T)
+    {
+        for (U32 x=0; x<cols; x += T)
+        {
+            tile t;
+            t.x    = (left + x) / T;
+            t.y    = (top  + y) / T;
+            t.cols = (cols - x > T) ? T : cols - x;
+            t.rows = (rows - y > T) ? T : rows - y;
+            m_tile.push_back(t);
+        }
+    }
+
+    // Start the encoder threads compressing tiles
+    CEncoder::StartJob(this, (U32)m_tile.size());
+
+    // As each tile finishes compressing (in order), append it to the file and record where it went
+    for (U32 item=0; item<m_tile.size(); ++item)
+    {
+        CEncoder::WaitForItem(item);
+
+        tile& t = m_tile[item];
+
+        U64 position = m_file.Tell();
+        if (ok && m_file.Write(t.packed.data(), t.packed.size()))
+        {
+            escape_tile_entry& entry = m_index[(size_t)t.y * m_hdr.tiles_across + t.x];
+            entry.offset = position;
+            entry.length = t.packed.size();
+        }
+        else ok = false;
+
+        // We're done with the compressed data
+        t.packed.clear();
+        t.packed.shrink_to_fit();
+    }
+
+    // Tell the caller whether all is well
+    return ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WriteIndex() - Writes the tile index to the end of the file, and the header to the front of it
+//=========================================================================================================
+bool CEscapeWriter::WriteIndex()
+{
+    // If any tile is missing, the file is useless
+    for (auto& entry : m_index) if (entry.length == 0) return false;
+
+    // The index goes at the end of the file
+    m_hdr.index_offset = m_file.Tell();
+    m_file.Write(m_index.data(), m_index.size() * sizeof(escape_tile_entry));
+
+    // Now that the header is complete, write it
+    m_file.Seek(0);
+    return m_file.Write(&m_hdr, sizeof m_hdr);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Close() - Writes the tile index and closes the output file, or optionally deletes it
+//=========================================================================================================
+bool CEscapeWriter::Close(bool erase)
+{
+    bool ok = true;
+
+    // If the file is open, finish it and close it
+    if (m_file.IsOpen())
+    {
+        // If we're going to keep this file, it needs its index
+        if (!erase && !WriteIndex()) {erase = true; ok = false;}
+
+        // Wait for our writes to finish and close the file.  If we've been asked to (or couldn't finish
+        // the file), it is deleted
+        if (!m_file.Close(erase) && !erase) ok = false;
+    }
+
+    // Free our buffers
+    m_tile.clear();
+    m_index.clear();
+
+    // Tell the caller whether the file was completely written
+    return ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Open() - Opens an escape-data file, checks its header, reads the tile index, and prepares the file for
+//          memory-mapping
+//=========================================================================================================
+bool CEscapeReader::Open(CString fn)
+{
+    DWORD         bytes_read;
+    LARGE_INTEGER position;
+    SYSTEM_INFO   info;
+
+    // Make sure any file we previously had open is closed
+    Close();
+
+    // Open the file
+    m_hfile = CreateFile(fn, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_hfile == INVALID_HANDLE_VALUE) return false;
+
+    // Read the header and make sure it's one we understand
+    if (!ReadFile(m_hfile, &m_hdr, sizeof m_hdr, &bytes_read, nullptr)
+    ||  bytes_read != sizeof m_hdr
+    ||  memcmp(m_hdr.magic, ESCAPE_MAGIC, sizeof m_hdr.magic) != 0
+    ||  m_hdr.version != ESCAPE_VERSION
+    ||  m_hdr.tile_size != ESCAPE_TILE_SIZE
+    ||  m_hdr.samples_per_pixel == 0
+    ||  m_hdr.samples_per_pixel > sizeof(frac_value) / sizeof(escape))
+    {
+        Close();
+        return false;
+    }
+
+    // Read the tile index
+    m_index.resize((size_t)m_hdr.tiles_across * m_hdr.tiles_down);
+    DWORD index_size = (DWORD)(m_index.size() * sizeof(escape_tile_entry));
+    position.QuadPart = m_hdr.index_offset;
+    if (!SetFilePointerEx(m_hfile, position, nullptr, FILE_BEGIN)
+    ||  !ReadFile(m_hfile, m_index.data(), index_size, &bytes_read, nullptr)
+    ||  bytes_read != index_size)
+    {
+        Close();
+        return false;
+    }
+
+    // Create a read-only mapping of the whole file.  Views of individual tiles are mapped on demand
+    m_hmap = CreateFileMapping(m_hfile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_hmap == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    // Find out how views of the file have to be aligned
+    GetSystemInfo(&info);
+    m_granularity = info.dwAllocationGranularity;
+
+    // Tell the caller that all is well
+    return true;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ReadTile() - Maps a single compressed tile of the file into memory and decodes it
+//=========================================================================================================
+bool CEscapeReader::ReadTile(U32 tile_x, U32 tile_y, escape_sample* samples)
+{
+    const U32 T = ESCAPE_TILE_SIZE;
+
+    // Find out where this tile is in the file
+    const escape_tile_entry& entry = m_index[(size_t)tile_y * m_hdr.tiles_across + tile_x];
+
+    // A view has to start on an allocation boundary, so back up to the one before the tile
+    U64 view_offset = entry.offset - entry.offset % m_granularity;
+    U64 view_length = entry.offset - view_offset + entry.length;
+
+    // Map a view of the tile
+    const U8* view = (const U8*)MapViewOfFile(m_hmap, FILE_MAP_READ, (DWORD)(view_offset >> 32),
+                                             (DWORD)view_offset, (SIZE_T)view_length);
+    if (view == nullptr) return false;
+
+    // Find out how much of the image this tile covers
+    U32 cols = m_hdr.cols - tile_x * T;
+    U32 rows = m_hdr.rows - tile_y * T;
+    if (cols > T) cols = T;
+    if (rows > T) rows = T;
+
+    // Decode it
+    bool ok = DecodeEscapeTile(view + (entry.offset - view_offset), (size_t)entry.length, samples, T, cols, rows,
+                               m_hdr.samples_per_pixel);
+
+    // We're done with the view
+    UnmapViewOfFile(view);
+
+    // Tell the caller whether all is well
+    return ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Close() - Closes the file
+//=========================================================================================================
+void CEscapeReader::Close()
+{
+    if (m_hmap) CloseHandle(m_hmap);
+    if (m_hfile != INVALID_HANDLE_VALUE) CloseHandle(m_hfile);
+    m_hmap  = nullptr;
+    m_hfile = INVALID_HANDLE_VALUE;
+    m_index.clear();
+}
+//=========================================================================================================
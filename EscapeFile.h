@@ -0,0 +1,173 @@
+//=========================================================================================================
+// EscapeFile.h - Describes the classes that write and read escape-data files
+//
+// An escape-data file holds the escape value of every sample of a full render, so the render can be
+// re-shaded with different colors without re-computing it.  The file is a header, followed by the
+// samples grouped into square tiles, followed by an index that gives the position and length of every
+// tile.  Each tile is compressed on its own (see EscapeCodec.h), so any tile can be read and decoded
+// without touching the rest of the file.
+//=========================================================================================================
+#pragma once
+#include "stdafx.h"
+#include "typedefs.h"
+#include "Encoder.h"
+#include "AsyncFile.h"
+
+// The width and height (in pixels) of a tile in an escape-data file
+#define ESCAPE_TILE_SIZE 256
+
+// The space reserved for the file header.  The first tile follows it
+#define ESCAPE_HDR_SIZE  4096
+
+//=========================================================================================================
+// escape_sample - The escape value of a single sample, as stored in the file
+//=========================================================================================================
+struct escape_sample
+{
+    U32   iter;
+    float distance;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ESCAPEHDR - The header at the front of an escape-data file
+//=========================================================================================================
+struct ESCAPEHDR
+{
+    char    magic[8];
+    U32     version;
+    U32     hdr_size;
+    U32     cols;
+    U32     rows;
+    U32     samples_per_pixel;
+    U32     tile_size;
+    U32     tiles_across;
+    U32     tiles_down;
+    U64     index_offset;
+    U32     dwell;
+    U32     reserved;
+    double  center_real;
+    double  center_imag;
+    double  span_real;
+    double  span_imag;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// escape_tile_entry - The entry in the tile index that tells where a compressed tile is in the file
+//=========================================================================================================
+struct escape_tile_entry
+{
+    U64     offset;
+    U64     length;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CEscapeWriter - Writes rectangular panels of samples into an escape-data file.  Every panel must start
+//                 on a tile boundary, and must be a whole number of tiles wide and tall unless it reaches
+//                 the right or bottom edge of the image.  The tiles of each panel are compressed in
+//                 parallel by the encoder threads and appended to the file.
+//=========================================================================================================
+class CEscapeWriter : public CEncodeJob
+{
+public:
+
+    // Default constructor
+    CEscapeWriter() {}
+
+    // Destructor closes the file if it's still open
+    ~CEscapeWriter() {Close();}
+
+    // Creates the output file at its full size and writes the header
+    bool    Create(CString fn, U32 cols, U32 rows, U32 samples_per_pixel);
+
+    // Writes a panel of samples into the file.  "left" and "top" are the image coordinates of the
+    // upper-left corner of the panel
+    bool    WritePanel(escape_sample* samples, U32 left, U32 top, U32 cols, U32 rows);
+
+    // Writes the tile index and closes the output file, or optionally deletes it.  Returns false if
+    // the file couldn't be completely written
+    bool    Close(bool erase = false);
+
+    // Called by the encoder threads to compress one tile
+    void    EncodeItem(U32 item, U32 thread);
+
+protected:
+
+    // Writes the tile index and the completed header
+    bool    WriteIndex();
+
+    // A tile of the current panel
+    struct tile
+    {
+        U32        x, y;
+        U32        cols, rows;
+        vector<U8> packed;
+    };
+
+    // The output file.  Tiles are always appended, so its position is the end of the file
+    CAsyncFile  m_file;
+
+    // The file header
+    ESCAPEHDR   m_hdr;
+
+    // The panel being written, and its tiles
+    escape_sample* m_samples;
+    U32         m_panel_left;
+    U32         m_panel_top;
+    U32         m_panel_cols;
+    vector<tile> m_tile;
+
+    // Where each tile of the image was written.  A tile that hasn't been written has a length of 0
+    vector<escape_tile_entry> m_index;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CEscapeReader - Reads and decodes individual tiles of an escape-data file.  The file is memory-mapped,
+//                 so any number of threads can read tiles at the same time
+//=========================================================================================================
+class CEscapeReader
+{
+public:
+
+    // Default constructor
+    CEscapeReader() {m_hfile = INVALID_HANDLE_VALUE; m_hmap = nullptr;}
+
+    // Destructor closes the file if it's still open
+    ~CEscapeReader() {Close();}
+
+    // Opens an escape-data file and reads its header
+    bool    Open(CString fn);
+
+    // Returns the file header
+    const ESCAPEHDR& Header() {return m_hdr;}
+
+    // Decodes a tile into "samples", which must have room for a full tile.  The samples are stored a row
+    // at a time, and each row is a full tile wide.  Returns false if the tile can't be read
+    bool    ReadTile(U32 tile_x, U32 tile_y, escape_sample* samples);
+
+    // Closes the file
+    void    Close();
+
+protected:
+
+    // The file, and the mapping object that lets us map views of it
+    HANDLE      m_hfile;
+    HANDLE      m_hmap;
+
+    // The file header
+    ESCAPEHDR   m_hdr;
+
+    // Where each tile is in the file
+    vector<escape_tile_entry> m_index;
+
+    // File offsets of mapped views must be a multiple of this
+    U32         m_granularity;
+};
+//=========================================================================================================
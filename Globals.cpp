@@ -6,19 +6,43 @@
 // This is the thread that manages all of the background tasks
 CWorker  Worker;
 
+// This is the thread that writes completed panels to disk
+CPanelWriter PanelWriter;
+
+// These are the class-threads that compress (or otherwise encode) output data
+CEncoder    Encoder[MAX_THREADS];
+
 // Memory that holds the viewport image
 pixel*   viewport;
 pixel*   panel;
 
-// This is the maximum size of the rendering panel, in pixels
-U32      max_panel_size;
+// This is how much memory (in megabytes) a full render may use for its panel buffers
+U32      memory_budget = 2048;
 
 // This is the width (in pixels) of a full render
 U32      render_width = 4000;
 
+// This is how a full render is split into panels (one of the RM_xxx constants)
+U32      render_mode = RM_COLUMNS;
+
+// This is the file format of a full render (one of the OF_xxx constants)
+U32      output_format = OF_BMP;
+
+// This will be true if full renders should also save the escape value of every sample
+bool     export_escape_data = false;
+
+// Each half of this buffer holds the escape values for one half of the panel buffer
+escape_sample* escape_buffer;
+
+// This reads the escape-data file when a render is being recolored
+CEscapeReader EscapeReader;
+
 // This stores all of the fractal values for re-coloring the viewport
 frac_value fractal[VIEWPORT_SIZE * VIEWPORT_SIZE];
 
+// This will be true if the fractal values of the viewport include distance estimates
+bool viewport_has_estimates;
+
 // This contains all of the settings needed for a plot
 plot_settings ps;
 
@@ -31,8 +55,11 @@ CShader    Shader;
 // This is the fixed-hue indicator
 CHueIndicator fixed_hue_indicator;
 
-// One imaginary value for every possible row in a panel
-double imaginary[1000000];
+// One imaginary value for every row in the current panel
+vector<double> imaginary;
+
+// The dwell limit of each panel of the current render
+vector<U32> panel_dwell;
 
 // Anchor point for the lasso
 int lasso_ancx;
@@ -64,8 +91,11 @@ stack<T_COORD> coord_stack;
 // This is the dwell limit
 U32 dwell = DEFAULT_DWELL;
 
-// The number of columns completed for this render
-volatile U32 columns_completed;
+// This will be true if the dwell limit is picked automatically for every view
+bool auto_dwell = false;
+
+// The number of pixels completed for this render
+volatile U64 pixels_completed;
 
 // The current state of the user-interface
 int ui_state = UI_IDLE;
@@ -88,10 +118,5 @@ BOOL invert_r, invert_b, invert_g, invert_all;
 // Will be true if colors should be converted to greyscale
 BOOL greyscale;
 
-// These are the cubic splines for building color gradients
-CubicMonoSpline spline_red;
-CubicMonoSpline spline_green;
-CubicMonoSpline spline_blue;
-
 // This will be true when we're aborting a render
 bool aborting;
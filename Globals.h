@@ -2,6 +2,8 @@
 #include "typedefs.h"
 
 #include "Plotter.h"
+#include "PanelWriter.h"
+#include "Encoder.h"
 #include <stack>
 #include <vector>
 #include <map>
@@ -27,13 +29,31 @@ enum
     UI_BUSY_RENDER
 };
 
+// Render modes
+enum
+{
+    RM_COLUMNS,
+    RM_BANDS,
+    RM_TILES
+};
+
+// Output image formats
+enum
+{
+    OF_BMP,
+    OF_TIFF,
+    OF_PNG,
+    OF_DZI
+};
+
 // Progress states
 enum
 {
     PROGRESS_STITCHING = -1000,
     PROGRESS_ABORTING,
     PROGRESS_ABORTED,
-    PROGRESS_FINISHED
+    PROGRESS_FINISHED,
+    PROGRESS_FAILED
 };
 
 //============================================================================
@@ -45,9 +65,18 @@ void CreateBuiltinPOI();
 //============================================================================
 
 //============================================================================
-// WriteBmp() - Miscellaneous helper tools
+// WriteBmp(), WritePng(), AllocateBuffer() - Miscellaneous helper tools
 //============================================================================
 bool  WriteBmp(CString fn, pixel* image, U32 cols, U32 rows, U32 panel_width = 0);
+bool  WritePng(CString fn, pixel* image, U32 cols, U32 rows, U32 stride = 0);
+void* AllocateBuffer(U64 bytes);
+void  FreeBuffer(void* buffer);
+//============================================================================
+
+//============================================================================
+// PlanDwell() - Picks the dwell limit for a region of the complex plane
+//============================================================================
+U32   PlanDwell(const T_COORD& region);
 //============================================================================
 
 
@@ -70,13 +99,20 @@ struct plot_settings
 {
     U32     rows;
     U32     columns;
+    U32     render_mode;
     U32     panel_width;
-    U32     cols_this_panel;
+    U32     panel_height;
     U32     panel_number;
+    U32     panel_left;
+    U32     panel_top;
+    U32     cols_this_panel;
+    U32     rows_this_panel;
     T_COORD coord;
     double  pixel_size;
     pixel*  bitmap;
     U32     oversample;
+    U32     dwell;
+    escape_sample* samples;
 };
 //=======================================================================
 
@@ -103,19 +139,45 @@ extern plot_settings ps;
 // This is the thread that manages all of the background tasks
 extern CWorker  Worker;
 
+// This is the thread that writes completed panels to disk
+extern CPanelWriter PanelWriter;
+
+// These are the class-threads that compress (or otherwise encode) output data
+extern CEncoder   Encoder[MAX_THREADS];
+
 // This bitmap holds the image we display in the viewport
 extern pixel*   viewport;
 extern pixel*   panel;
 
-// This is the maximum size of the rendering panel, in pixels
-extern U32      max_panel_size;
+// This is how much memory (in megabytes) a full render may use for its panel buffers.  The panel
+// buffer is allocated when a full render starts, and is split into two halves so that one half can
+// be written to disk while the other is being plotted
+extern U32      memory_budget;
 
 // This is the width (in pixels) of a full render
 extern U32      render_width;
 
+// This is how a full render is split into panels (one of the RM_xxx constants)
+extern U32      render_mode;
+
+// This is the file format of a full render (one of the OF_xxx constants)
+extern U32      output_format;
+
+// This will be true if full renders should also save the escape value of every sample
+extern bool     export_escape_data;
+
+// Each half of this buffer holds the escape values for one half of the panel buffer
+extern escape_sample* escape_buffer;
+
+// This reads the escape-data file when a render is being recolored
+extern CEscapeReader EscapeReader;
+
 // This stores all of the fractal values for re-coloring the viewport
 extern frac_value fractal[VIEWPORT_SIZE * VIEWPORT_SIZE];
 
+// This will be true if the fractal values of the viewport include distance estimates
+extern bool viewport_has_estimates;
+
 // These are the class-threads that perform the point-plotting
 extern CPlotter   Plotter[MAX_THREADS];
 
@@ -125,8 +187,11 @@ extern  CShader    Shader;
 // This is the fixed-hue indicator
 extern CHueIndicator fixed_hue_indicator;
 
-// One imaginary value for every possible row in a panel
-extern double imaginary[1000000];
+// One imaginary value for every row in the current panel
+extern vector<double> imaginary;
+
+// The dwell limit of each panel of the current render
+extern vector<U32> panel_dwell;
 
 // The co-ordinates of the upper-left corner of the viewport;
 extern int viewport_ulx;
@@ -157,8 +222,11 @@ extern stack<T_COORD> coord_stack;
 // This is the dwell limit
 extern U32 dwell;
 
-// The number of columns completed for this render
-extern volatile U32 columns_completed;
+// This will be true if the dwell limit is picked automatically for every view
+extern bool auto_dwell;
+
+// The number of pixels completed for this render
+extern volatile U64 pixels_completed;
 
 // The current state of the user-interface
 extern int ui_state;
@@ -182,10 +250,5 @@ extern BOOL invert_r, invert_b, invert_g, invert_all;
 // Will be true if colors should be converted to greyscale
 extern BOOL greyscale;
 
-// These are the cubic splines for building color gradients
-extern CubicMonoSpline spline_red;
-extern CubicMonoSpline spline_green;
-extern CubicMonoSpline spline_blue;
-
 // This will be true when we're aborting a render
 extern bool aborting;
@@ -3,6 +3,13 @@
 //=========================================================================================================
 #include "stdafx.h"
 #include "typedefs.h"
+#include "Image.h"
+#include "Globals.h"
+#include <intrin.h>
+#include <tmmintrin.h>
+
+// The approximate size of a block of rows that an encoder thread packs into BMP format
+static const U32 BLOCK_BYTES = 1024 * 1024;
 
 //=========================================================================================================
 // This is the structure of the header for an image file in the BMP format
@@ -26,6 +33,64 @@ struct BITMAPHDR
 //=========================================================================================================
 
 
+//=========================================================================================================
+// HaveSsse3() - Returns true if this CPU supports the SSSE3 instructions
+//=========================================================================================================
+static bool HaveSsse3()
+{
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// PackBgr() - Converts a row of 4-byte pixels into 3-byte pixels by dropping the alpha byte.  Where the
+//             CPU supports it, this shuffles 16 pixels at a time: each group of 4 pixels is squeezed
+//             into 12 bytes, and the four groups are merged into three 16-byte stores
+//=========================================================================================================
+void PackBgr(const pixel* in, U8* out, U32 count)
+{
+    static const bool have_ssse3 = HaveSsse3();
+
+    if (have_ssse3)
+    {
+        // Moves the B, G, and R bytes of 4 pixels into the low 12 bytes, and zeros the rest
+        const __m128i squeeze = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+        // Pack 16 pixels at a time
+        for (; count >= 16; count -= 16, in += 16, out += 48)
+        {
+            __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in +  0)), squeeze);
+            __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in +  4)), squeeze);
+            __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in +  8)), squeeze);
+            __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 12)), squeeze);
+            _mm_storeu_si128((__m128i*)(out +  0), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+            _mm_storeu_si128((__m128i*)(out + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+            _mm_storeu_si128((__m128i*)(out + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+        }
+
+        // Then 4 at a time.  Each store writes 16 bytes, so we stop while there are at least 16 bytes
+        // of output left to write
+        for (; count >= 6; count -= 4, in += 4, out += 12)
+        {
+            __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), squeeze);
+            _mm_storeu_si128((__m128i*)out, a);
+        }
+    }
+
+    // Pack whatever pixels are left one at a time
+    for (; count; --count, ++in)
+    {
+        *out++ = in->b;
+        *out++ = in->g;
+        *out++ = in->r;
+    }
+}
+//=========================================================================================================
+
+
 //=========================================================================================================
 // WriteBmp() - Writes a bitmap image file
 //=========================================================================================================
@@ -98,13 +163,8 @@ bool WriteBmp(CString fn, pixel* image, U32 cols, U32 rows, U32 panel_width)
         pixel* p_pixel = image + scanline * panel_width;
 
         // Create the row of pixels
-        for (U32 x=0; x<cols; ++x)
-        {
-            *out++ = p_pixel->b;
-            *out++ = p_pixel->g;
-            *out++ = p_pixel->r;
-            ++p_pixel;
-        }
+        PackBgr(p_pixel, out, cols);
+        out += cols * 3;
 
         *out++ = 0;
         *out++ = 0;
@@ -120,3 +180,204 @@ bool WriteBmp(CString fn, pixel* image, U32 cols, U32 rows, U32 panel_width)
     return true;
 }
 //=========================================================================================================
+
+
+//=========================================================================================================
+// Create() - Creates the output file, writes its header, and extends it to its final size so that
+//            panels can be written into it in any order
+//=========================================================================================================
+bool CBmpWriter::Create(CString fn, U32 cols, U32 rows)
+{
+    BITMAPHDR hdr;
+
+    // Make sure any file we previously had open is closed
+    Close();
+
+    // Create and open the output file
+    if (!m_file.Create(fn)) return false;
+
+    // Keep track of the image dimensions
+    m_cols = cols;
+    m_rows = rows;
+
+    // In the file, a row must be padded such that it's length is divisible by 4
+    m_padded_row_length = (cols * 3 + 3) & ~3;
+
+    // Decide how many rows go into each block that an encoder thread packs
+    m_block_rows = BLOCK_BYTES / m_padded_row_length;
+    if (m_block_rows == 0) m_block_rows = 1;
+
+    // Clear the header to all zeros
+    memset(&hdr, 0, sizeof hdr);
+
+    // Fill in the signature
+    hdr.magic[0] = 'B';
+    hdr.magic[1] = 'M';
+
+    // Fill in the total size of the file
+    hdr.total_size = (U32)(sizeof(hdr) + (U64)m_padded_row_length * rows);
+
+    // Offset (in the file) to the pixel data
+    hdr.pixel_offset = sizeof hdr;
+
+    // Fill in the dimensions of the image
+    hdr.width  = cols;
+    hdr.height = rows;
+
+    // We're using the standard 40-byte BMP image header
+    hdr.hdr_size = 40;
+
+    // Only 1 bitplane
+    hdr.planes = 1;
+
+    // We're writing 24 bits per pixel
+    hdr.bitcount = 24;
+
+    // Extend the file to its full size, so that no write ever has to extend it.  The padding bytes at
+    // the end of each row will be zero
+    if (!m_file.SetSize(sizeof(hdr) + (U64)m_padded_row_length * rows))
+    {
+        Close(true);
+        return false;
+    }
+
+    // Write the file header to the file
+    m_file.Write(&hdr, sizeof(hdr));
+
+    // Tell the caller that all is well
+    return true;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// GetBlockRows() - Finds the rows of the current panel that make up a block.  Blocks are numbered from
+//                  the bottom of the panel up, so that they are written forward through the file
+//=========================================================================================================
+void CBmpWriter::GetBlockRows(U32 block, U32* first_row, U32* row_count)
+{
+    U32 end_row = m_panel_rows - block * m_block_rows;
+    *row_count  = (end_row > m_block_rows) ? m_block_rows : end_row;
+    *first_row  = end_row - *row_count;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// EncodeItem() - Called by encoder thread "thread" to pack block number "item" of the current batch
+//=========================================================================================================
+void CBmpWriter::EncodeItem(U32 item, U32 thread)
+{
+    U32 first_row, row_count;
+
+    // Find the rows that make up this block
+    GetBlockRows(m_first_block + item, &first_row, &row_count);
+
+    // Make sure this block's buffer is big enough
+    vector<U8>& block = m_block[item];
+    block.resize((size_t)row_count * m_row_length);
+    U8* out = block.data();
+
+    // Pack each row, starting at the bottom, since rows are stored in the file from bottom to top
+    for (U32 y=first_row + row_count; y-- > first_row;)
+    {
+        PackBgr(m_bitmap + (U64)y * m_panel_cols, out, m_panel_cols);
+
+        // If we're writing the padding bytes, they must be zero
+        memset(out + m_panel_cols * 3, 0, m_row_length - m_panel_cols * 3);
+
+        out += m_row_length;
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WritePanel() - Packs the rows of a panel into file format and writes each one directly to its final
+//                location in the file
+//=========================================================================================================
+bool CBmpWriter::WritePanel(pixel* bitmap, U32 left, U32 top, U32 cols, U32 rows)
+{
+    bool ok = true;
+
+    // If the output file isn't open, we can't write anything
+    if (!m_file.IsOpen()) return false;
+
+    // If the panel spans the full width of the image, we can write the row padding along with the pixels
+    bool full_width = (left == 0 && cols == m_cols);
+
+    // Record the panel we're about to pack
+    m_bitmap     = bitmap;
+    m_panel_cols = cols;
+    m_panel_rows = rows;
+    m_row_length = full_width ? m_padded_row_length : cols * 3;
+
+    // Find out how many blocks make up this panel.  They're packed in batches, so that we only ever
+    // need a few blocks' worth of buffers
+    U32 block_count = (rows + m_block_rows - 1) / m_block_rows;
+    U32 batch_size  = 2 * cpu_count;
+    m_block.resize(batch_size);
+
+    // Loop through each batch of blocks...
+    for (U32 first=0; ok && first<block_count; first += batch_size)
+    {
+        U32 item_count = (block_count - first < batch_size) ? block_count - first : batch_size;
+
+        // Start the encoder threads packing this batch
+        m_first_block = first;
+        CEncoder::StartJob(this, item_count);
+
+        // As each block finishes packing (in order), write it to the file
+        for (U32 item=0; item<item_count; ++item)
+        {
+            U32 first_row, row_count;
+
+            // Wait for this block to be packed
+            CEncoder::WaitForItem(item);
+            if (!ok) continue;
+
+            // Find out where the bottom row of the block lives in the file
+            GetBlockRows(first + item, &first_row, &row_count);
+            U32 scanline = m_rows - (top + first_row + row_count - 1) - 1;
+            U64 offset   = sizeof(BITMAPHDR) + (U64)scanline * m_padded_row_length + left * 3;
+
+            // If the panel spans the full width of the image, the rows of the block are one contiguous
+            // run in the file.  Otherwise, each row has to be written separately
+            const U8* data = m_block[item].data();
+            if (full_width)
+            {
+                m_file.Seek(offset);
+                ok = m_file.Write(data, (size_t)row_count * m_row_length);
+            }
+            else for (U32 y=0; ok && y<row_count; ++y)
+            {
+                m_file.Seek(offset + (U64)y * m_padded_row_length);
+                ok = m_file.Write(data + (size_t)y * m_row_length, m_row_length);
+            }
+        }
+    }
+
+    // Tell the caller whether all is well
+    return ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Close() - Closes the output file, and optionally deletes it
+//=========================================================================================================
+bool CBmpWriter::Close(bool erase)
+{
+    bool ok = true;
+
+    // Wait for all of our writes to finish and close the file
+    if (m_file.IsOpen() && !m_file.Close(erase) && !erase) ok = false;
+
+    // Free our block buffers
+    m_block.clear();
+    m_block.shrink_to_fit();
+
+    // Tell the caller whether the file was completely written
+    return ok;
+}
+//=========================================================================================================
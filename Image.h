@@ -0,0 +1,98 @@
+//=========================================================================================================
+// Image.h - Describes the classes that write rendered images to disk
+//=========================================================================================================
+#pragma once
+#include "stdafx.h"
+#include "typedefs.h"
+#include "AsyncFile.h"
+#include "Encoder.h"
+#include <vector>
+using std::vector;
+
+//=========================================================================================================
+// PackBgr() - Converts a row of 4-byte pixels into the 3-byte B, G, R format used in BMP files
+//=========================================================================================================
+void PackBgr(const pixel* in, U8* out, U32 count);
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CImageWriter - The interface to a class that writes a rendered image to disk one panel at a time
+//=========================================================================================================
+class CImageWriter
+{
+public:
+
+    virtual ~CImageWriter() {}
+
+    // Creates the output file for an image of the specified size
+    virtual bool    Create(CString fn, U32 cols, U32 rows) = 0;
+
+    // Writes a panel of pixels into the file.  "left" and "top" are the image coordinates of the
+    // upper-left corner of the panel
+    virtual bool    WritePanel(pixel* bitmap, U32 left, U32 top, U32 cols, U32 rows) = 0;
+
+    // Finishes writing the file and closes it, optionally deleting it.  Returns false if the file
+    // couldn't be completely written (in which case it is deleted)
+    virtual bool    Close(bool erase = false) = 0;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CBmpWriter - Writes rectangular panels of pixels straight into their final position in a BMP file.
+//              Each panel is split into blocks of rows that are packed into file format in parallel by
+//              the encoder threads, then written to the file in order.
+//=========================================================================================================
+class CBmpWriter : public CImageWriter, public CEncodeJob
+{
+public:
+
+    // Default constructor
+    CBmpWriter() {}
+
+    // Destructor closes the file if it's still open
+    ~CBmpWriter() {Close();}
+
+    // Creates the output file at its full size and writes the header
+    bool    Create(CString fn, U32 cols, U32 rows);
+
+    // Writes a panel of pixels into the file.  "left" and "top" are the image coordinates of the
+    // upper-left corner of the panel
+    bool    WritePanel(pixel* bitmap, U32 left, U32 top, U32 cols, U32 rows);
+
+    // Closes the output file, optionally deleting it.  Returns false if a write failed
+    bool    Close(bool erase = false);
+
+    // Called by the encoder threads to pack one block of rows of the current panel
+    void    EncodeItem(U32 item, U32 thread);
+
+protected:
+
+    // Finds the rows of the current panel that make up a block.  Block 0 is at the bottom of the panel
+    void    GetBlockRows(U32 block, U32* first_row, U32* row_count);
+
+    // The output file
+    CAsyncFile m_file;
+
+    // Dimensions of the complete image
+    U32     m_cols;
+    U32     m_rows;
+
+    // The length (in bytes) of a row of pixels in the file, including padding bytes
+    U32     m_padded_row_length;
+
+    // The number of rows in each block
+    U32     m_block_rows;
+
+    // The panel currently being packed, and how many bytes of each of its rows go into the file
+    pixel*  m_bitmap;
+    U32     m_panel_cols, m_panel_rows;
+    U32     m_row_length;
+
+    // The first block of the batch being packed, and a buffer for each block of the batch.  The rows of
+    // a block are stored in the order they appear in the file (bottom row first)
+    U32     m_first_block;
+    vector<vector<U8>> m_block;
+};
+//=========================================================================================================
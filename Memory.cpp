@@ -0,0 +1,80 @@
+//=========================================================================================================
+// Memory.cpp - Allocates the large buffers that hold panels during a full render
+//
+// These buffers are allocated straight from the operating system rather than from the heap, so they
+// are returned to the system the moment the render is done.  Where the user has the "Lock pages in
+// memory" privilege, they are backed by large pages, which saves a great many TLB misses when plotter
+// threads are writing all over a multi-gigabyte buffer.  Otherwise they are ordinary pages, which the
+// system doesn't actually hand us until they are first touched.
+//=========================================================================================================
+#include "stdafx.h"
+#include "Globals.h"
+
+
+//=========================================================================================================
+// EnableLargePages() - Tries to enable the privilege that large-page allocations require.  Returns the
+//                      size of a large page, or 0 if large pages aren't available
+//=========================================================================================================
+static SIZE_T EnableLargePages()
+{
+    HANDLE           token;
+    TOKEN_PRIVILEGES tp;
+
+    // If the system doesn't support large pages, don't bother
+    SIZE_T large_page_size = GetLargePageMinimum();
+    if (large_page_size == 0) return 0;
+
+    // Fetch the access token for our process
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return 0;
+
+    // Try to enable the "Lock pages in memory" privilege.  AdjustTokenPrivileges() reports success even
+    // when the privilege wasn't granted, so we have to check GetLastError() too
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool ok = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+           && AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr)
+           && GetLastError() == ERROR_SUCCESS;
+
+    CloseHandle(token);
+
+    // Tell the caller whether large pages are available
+    return ok ? large_page_size : 0;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// AllocateBuffer() - Allocates a large buffer, using large pages if we can.  Returns nullptr if the
+//                    memory isn't available
+//=========================================================================================================
+void* AllocateBuffer(U64 bytes)
+{
+    // Find out (once) whether we can use large pages
+    static SIZE_T large_page_size = EnableLargePages();
+
+    // Make sure the request is something we can satisfy
+    if (bytes == 0 || bytes > (SIZE_T)-1) return nullptr;
+
+    // If we can, try to allocate the buffer from large pages.  The size must be a multiple of the
+    // large page size
+    if (large_page_size)
+    {
+        SIZE_T size = (SIZE_T)((bytes + large_page_size - 1) / large_page_size * large_page_size);
+        void* buffer = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (buffer) return buffer;
+    }
+
+    // Otherwise, fall back to ordinary pages
+    return VirtualAlloc(nullptr, (SIZE_T)bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// FreeBuffer() - Frees a buffer that was allocated by "AllocateBuffer()"
+//=========================================================================================================
+void FreeBuffer(void* buffer)
+{
+    if (buffer) VirtualFree(buffer, 0, MEM_RELEASE);
+}
+//=========================================================================================================
@@ -0,0 +1,156 @@
+//=========================================================================================================
+// PanelWriter.cpp - Writes completed panels into the output image in the background
+//=========================================================================================================
+#include "stdafx.h"
+#include "PanelWriter.h"
+#include "Globals.h"
+
+
+//=========================================================================================================
+// Init() - Initialize the thread
+//=========================================================================================================
+void CPanelWriter::Init()
+{
+    m_is_busy = false;
+    m_ok      = true;
+    m_image   = &m_bmp;
+    CreatePipe(&m_hread_cmd, &m_hwrite_cmd, NULL, 0);
+    CreatePipe(&m_hread_rsp, &m_hwrite_rsp, NULL, 0);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Open() - Creates the output image that panels will be written into
+//=========================================================================================================
+bool CPanelWriter::Open(CString fn, U32 format, U32 cols, U32 rows)
+{
+    // Choose the writer for the requested format
+    switch (format)
+    {
+    case OF_TIFF:
+        m_image = &m_tiff;
+        break;
+
+    case OF_PNG:
+        m_image = &m_png;
+        break;
+
+    case OF_DZI:
+        m_image = &m_dzi;
+        break;
+
+    default:
+        m_image = &m_bmp;
+    }
+
+    // Nothing has gone wrong with this image yet
+    m_ok = true;
+
+    // And create the output file
+    return m_image->Create(fn, cols, rows);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// OpenEscapeData() - Creates the escape-data file that panel samples will be written into
+//=========================================================================================================
+bool CPanelWriter::OpenEscapeData(CString fn, U32 cols, U32 rows, U32 samples_per_pixel)
+{
+    return m_escape.Create(fn, cols, rows, samples_per_pixel);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Start() - Hands this thread a panel to write.  The caller must not modify the bitmap or samples until
+//           "Wait()" has returned.  "samples" is nullptr if the escape data isn't being saved
+//=========================================================================================================
+void CPanelWriter::Start(pixel* bitmap, escape_sample* samples, U32 left, U32 top, U32 cols, U32 rows)
+{
+    char command = 0;
+
+    // Make sure any panel we were already writing is finished
+    Wait();
+
+    // Record the panel we're about to write
+    m_bitmap  = bitmap;
+    m_samples = samples;
+    m_left    = left;
+    m_top     = top;
+    m_cols    = cols;
+    m_rows    = rows;
+
+    // We are now busy writing a panel
+    m_is_busy = true;
+
+    // And wake up the thread
+    WriteFile(m_hwrite_cmd, &command, 1, nullptr, nullptr);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Wait() - Waits for this thread to finish writing the current panel
+//=========================================================================================================
+bool CPanelWriter::Wait()
+{
+    char buffer;
+
+    // If we're writing a panel, wait for the thread to tell us that it's done
+    if (m_is_busy)
+    {
+        ReadFile(m_hread_rsp, &buffer, 1, nullptr, nullptr);
+        m_is_busy = false;
+    }
+
+    // Tell the caller whether every panel has been written
+    return m_ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Close() - Waits for the last panel to be written, then closes the output image and escape-data file.
+//           If any panel couldn't be written, the files are incomplete, and are deleted
+//=========================================================================================================
+bool CPanelWriter::Close(bool erase)
+{
+    // Wait for the last panel, and find out whether every panel made it to disk
+    bool ok = Wait();
+    if (!ok) erase = true;
+
+    // Close both files.  Either one can fail while it's being finished
+    if (!m_image->Close(erase)) ok = false;
+    if (!m_escape.Close(erase)) ok = false;
+
+    // Tell the caller whether the files were completely written
+    return ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Main() - Writes each panel we're handed into the output image
+//=========================================================================================================
+void CPanelWriter::Main(int P1, int P2, int P3)
+{
+    char command, dummy = 0;
+
+    while (true)
+    {
+        // Wait for a new panel to arrive
+        ReadFile(m_hread_cmd, &command, 1, nullptr, nullptr);
+
+        // Write the panel into its place in the output image
+        if (!m_image->WritePanel(m_bitmap, m_left, m_top, m_cols, m_rows)) m_ok = false;
+
+        // If we were handed the samples of the panel, write them into the escape-data file
+        if (m_samples && !m_escape.WritePanel(m_samples, m_left, m_top, m_cols, m_rows)) m_ok = false;
+
+        // And tell the worker thread that we're done
+        WriteFile(m_hwrite_rsp, &dummy, 1, nullptr, nullptr);
+    }
+}
+//=========================================================================================================
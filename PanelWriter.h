@@ -0,0 +1,72 @@
+#pragma once
+#include "CThread.h"
+#include "typedefs.h"
+#include "Image.h"
+#include "TiffWriter.h"
+#include "PngWriter.h"
+#include "DziWriter.h"
+#include "EscapeFile.h"
+
+//=========================================================================================================
+// CPanelWriter - This is the class/thread that writes a completed panel into the output image while
+//                the plotter threads are busy computing the next panel
+//=========================================================================================================
+class CPanelWriter : public CThread
+{
+public:
+
+    // Initialize this thread
+    void Init();
+
+    // This routine is called when this thread spawns
+    void Main(int P1, int P2, int P3);
+
+    // Creates the output image (in one of the OF_xxx formats) that panels will be written into
+    bool Open(CString fn, U32 format, U32 cols, U32 rows);
+
+    // Creates the escape-data file that the samples of each panel will be written into
+    bool OpenEscapeData(CString fn, U32 cols, U32 rows, U32 samples_per_pixel);
+
+    // Starts writing a panel into the output image, and its samples (if any) into the escape-data file
+    void Start(pixel* bitmap, escape_sample* samples, U32 left, U32 top, U32 cols, U32 rows);
+
+    // Waits for the panel currently being written (if any) to finish.  Returns false if any panel
+    // couldn't be written
+    bool Wait();
+
+    // Closes the output image and escape-data file, optionally deleting them.  If any panel couldn't be
+    // written, they are deleted and this returns false
+    bool Close(bool erase = false);
+
+protected:
+
+    // The writers for each of the image formats we support
+    CBmpWriter  m_bmp;
+    CTiffWriter m_tiff;
+    CPngWriter  m_png;
+    CDziWriter  m_dzi;
+
+    // The output image, which is one of the writers above
+    CImageWriter* m_image;
+
+    // The escape-data file
+    CEscapeWriter m_escape;
+
+    // The panel we have been asked to write
+    pixel*  m_bitmap;
+    escape_sample* m_samples;
+    U32     m_left;
+    U32     m_top;
+    U32     m_cols;
+    U32     m_rows;
+
+    // This will be true from the time "Start()" is called until "Wait()" returns
+    bool    m_is_busy;
+
+    // This will be false if any panel couldn't be written
+    bool    m_ok;
+
+    HANDLE  m_hread_cmd, m_hwrite_cmd;
+    HANDLE  m_hread_rsp, m_hwrite_rsp;
+};
+//=========================================================================================================
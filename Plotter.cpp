@@ -1,24 +1,82 @@
 #include "stdafx.h"
 #include "Plotter.h"
 #include "Globals.h"
+#include "AsyncFile.h"
 #include "Stitcher.h"
 #include <math.h>
+#include <float.h>
+#include <algorithm>
 
 const double ONE_OVER_LOG2 = 1.44269504;
 
+// An orbit whose derivative with respect to its starting point shrinks (squared) below this has been
+// drawn into an attracting cycle, and is inside the set
+const double INTERIOR_THRESHOLD = 1e-20;
+
+// The longest cycle that an interior distance estimate looks for, and how close (squared) z has to come
+// back to itself to have completed the cycle
+const int    MAX_PERIOD       = 4096;
+const double PERIOD_TOLERANCE = 1e-16;
+
+// The low-resolution prepass of a full render is this many pixels along its longer side
+const U32 PREPASS_SIZE = 512;
+
+// The prepass of a recolor decodes about this many tiles of the escape-data file
+const U32 PREPASS_TILES = 64;
+
+// The histogram of escape counts never has more bins than this.  At higher dwells, each bin counts a
+// range of escape counts
+const U32 MAX_HISTOGRAM_BINS = 65536;
+
+// The cost of plotting a panel is predicted for groups of this many columns, from this many points down
+// the middle column of each group
+const U32 COST_GROUP_WIDTH = 8;
+const U32 COST_PROBE_ROWS  = 16;
+
+// A column that is predicted to cost more than 1/COST_SHARE of a thread's share of the panel is split
+// into ranges of rows, but never into ranges of fewer than MIN_SPLIT_ROWS rows
+const U32 COST_SHARE     = 16;
+const U32 MIN_SPLIT_ROWS = 64;
+
 
 //=========================================================================================================
 // Variables common to all instances of this class
 //=========================================================================================================
-volatile U32 CPlotter::m_next_column;
-CCriticalSection columns_completed_cs;
+volatile U32 CPlotter::m_next_unit;
+volatile U32 CPlotter::m_next_tile;
+volatile bool CPlotter::m_read_failed;
+U32          CPlotter::m_histogram_bins;
+U32          CPlotter::m_histogram_width;
+vector<U64>  CPlotter::m_merged_histogram;
+vector<U16>  CPlotter::m_cycle_index;
+U32          CPlotter::m_cycle_shift;
+const vector<complex>* CPlotter::m_points;
+U32          CPlotter::m_points_limit;
+vector<escape>* CPlotter::m_points_result;
+int          CPlotter::m_fractal_symmetry;
+int          CPlotter::m_symmetry;
+int          CPlotter::m_mirror_row_sum;
+int          CPlotter::m_mirror_col_sum;
+vector<CPlotter::work_unit> CPlotter::m_work;
+U64          CPlotter::m_panel_start;
+U64          CPlotter::m_idle_ticks;
+U64          CPlotter::m_thread_ticks;
+CCriticalSection pixels_completed_cs;
 //=========================================================================================================
 
+static U32 PanelAt(U32 x, U32 y);
+
 
 //=========================================================================================================
 // This points to a fractal iterator function
 //=========================================================================================================
-escape (*Iterator)(double real, double imag);
+escape (*Iterator)(double real, double imag, U32 max_iter);
+
+// And this points to the same iterator, but one that also estimates the distance to the set
+escape (*IteratorDE)(double real, double imag, U32 max_iter);
+
+// And this one estimates the distance to the boundary from points inside the set as well
+escape (*IteratorDEI)(double real, double imag, U32 max_iter);
 //=========================================================================================================
 
 
@@ -40,83 +98,341 @@ complex square_and_add(complex n, complex c)
 
 
 
+//=========================================================================================================
+// derivative_step() - Given z and the derivative dz, computes the derivative of z^2 + c, which is
+//                     2 * z * dz + k.  "k" is 1 when differentiating with respect to c, and 0 when
+//                     differentiating with respect to the starting value of z
+//=========================================================================================================
+complex derivative_step(complex z, complex dz, double k)
+{
+    complex result;
+    result.real = 2 * (z.real * dz.real - z.imag * dz.imag) + k;
+    result.imag = 2 * (z.real * dz.imag + z.imag * dz.real);
+    return result;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// distance_estimate() - Estimates the distance to the set from a point that has escaped, given the
+//                       final z and its derivative: |z| * log|z| / |dz|
+//=========================================================================================================
+double distance_estimate(complex z, complex dz)
+{
+    double abs_squared    = z.real * z.real + z.imag * z.imag;
+    double dz_abs_squared = dz.real * dz.real + dz.imag * dz.imag;
+
+    // If the derivative vanished, we can't say how far away the set is
+    if (dz_abs_squared == 0) return 0;
+
+    return sqrt(abs_squared / dz_abs_squared) * 0.5 * log(abs_squared);
+}
+//=========================================================================================================
+
+
+
+//=========================================================================================================
+// multiply() - Multiplies two complex numbers
+//=========================================================================================================
+complex multiply(complex a, complex b)
+{
+    complex result;
+    result.real = a.real * b.real - a.imag * b.imag;
+    result.imag = a.real * b.imag + a.imag * b.real;
+    return result;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// interior_estimate() - Estimates the distance to the boundary of the Mandelbrot set from a point "c"
+//                       inside it, given a "z" that its orbit has been drawn into an attracting cycle
+//                       with.  Returns 0 if the cycle can't be pinned down
+//
+// The period of the cycle is the number of iterations it takes z to come back to where it is.  The
+// derivatives of the orbit over one trip around the cycle then give the estimate:
+//
+//     (1 - |dz/dz|^2) / |d2z/dcdz + d2z/dz2 * (dz/dc) / (1 - dz/dz)|
+//=========================================================================================================
+double interior_estimate(complex z, complex c)
+{
+    complex w = z;
+    int     period = 0;
+
+    // Find the period of the cycle
+    for (int i=1; i<=MAX_PERIOD; ++i)
+    {
+        w = square_and_add(w, c);
+        double dr = w.real - z.real, di = w.imag - z.imag;
+        if (dr * dr + di * di < PERIOD_TOLERANCE)
+        {
+            period = i;
+            break;
+        }
+    }
+
+    // If z never came back, we can't estimate anything
+    if (period == 0) return 0;
+
+    // Differentiate the orbit once around the cycle
+    complex dz = {1, 0}, dc = {0, 0}, dzdz = {0, 0}, dcdz = {0, 0};
+    for (int i=0; i<period; ++i)
+    {
+        complex z_dcdz = multiply(z, dcdz), dc_dz = multiply(dc, dz);
+        complex dz_dz  = multiply(dz, dz),  z_dzdz = multiply(z, dzdz);
+        dcdz.real = 2 * (z_dcdz.real + dc_dz.real);
+        dcdz.imag = 2 * (z_dcdz.imag + dc_dz.imag);
+        dzdz.real = 2 * (dz_dz.real + z_dzdz.real);
+        dzdz.imag = 2 * (dz_dz.imag + z_dzdz.imag);
+        dz = derivative_step(z, dz, 0);
+        dc = derivative_step(z, dc, 1);
+        z  = square_and_add(z, c);
+    }
+
+    // Compute (dz/dc) / (1 - dz/dz)
+    complex one_minus_dz = {1 - dz.real, -dz.imag};
+    double  denominator  = one_minus_dz.real * one_minus_dz.real + one_minus_dz.imag * one_minus_dz.imag;
+    if (denominator == 0) return 0;
+    complex conjugate = {one_minus_dz.real / denominator, -one_minus_dz.imag / denominator};
+    complex quotient  = multiply(dc, conjugate);
+
+    // And add it (times d2z/dz2) to d2z/dcdz
+    complex sum = multiply(dzdz, quotient);
+    sum.real += dcdz.real;
+    sum.imag += dcdz.imag;
+
+    double magnitude = sqrt(sum.real * sum.real + sum.imag * sum.imag);
+    if (magnitude == 0) return 0;
+
+    return (1 - (dz.real * dz.real + dz.imag * dz.imag)) / magnitude;
+}
+//=========================================================================================================
+
+
+
 //=========================================================================================================
 // Iterator_Mandelbrot() - Iterator for the Mandlebrot set
 //=========================================================================================================
-escape Iterator_Mandelbrot(double real, double imag)
+escape Iterator_Mandelbrot(double real, double imag, U32 max_iter)
 {
     // Define this point on the complex plane
     complex c = { real, imag };
 
     // We begin our iterated complex value at c
     complex z = c;
+    double  abs_squared = c.real * c.real + c.imag * c.imag;
+
+    // This is the magnitude (squared) of the derivative of z with respect to where it started.  It's
+    // the product of |2z|^2 over the orbit, so it costs only a multiply per iteration to keep
+    double dz_abs_squared = 1.0;
 
     // So far we've done no iterations
     int iter = 0;
 
     // Iterate on z^2 + c...
-    while (iter < (int)dwell)
+    while (iter < (int)max_iter)
     {
         // Keep track of how many iterations we do
         ++iter;
 
-        // Compute the new value of 'z'
+        // Compute the new value of 'z', and of the derivative's magnitude
+        dz_abs_squared *= 4 * abs_squared;
         z = square_and_add(z, c);
+        abs_squared = z.real * z.real + z.imag * z.imag;
 
         // If our new point has gone out of bounds, keep track of how long it took
-        if ((z.real * z.real + z.imag * z.imag) >= 4.0)
+        if (abs_squared >= 4.0)
         {
             z = square_and_add(z, c);
             z = square_and_add(z, c);
 
-            double abs_squared = z.real * z.real + z.imag * z.imag;
+            abs_squared = z.real * z.real + z.imag * z.imag;
+
+            return{ iter, iter, abs_squared, 0.0 };
+        }
+
+        // If the derivative has collapsed, the orbit has been drawn into an attracting cycle
+        if (dz_abs_squared < INTERIOR_THRESHOLD) break;
+    }
+
+    // We never exceeded the escape radius
+    return{ 0, iter, 0.0, 0.0 };
+}
+//=========================================================================================================
+
+
+
+//=========================================================================================================
+// iterate_de_mandelbrot() - Iterates the Mandlebrot set while tracking the derivative dz/dc, to estimate
+//                           the distance to the set.  If "interior" is true, points inside the set that
+//                           are detected by their derivative get an interior distance estimate
+//=========================================================================================================
+static inline escape iterate_de_mandelbrot(double real, double imag, U32 max_iter, bool interior)
+{
+    // Define this point on the complex plane
+    complex c = { real, imag };
+
+    // We begin our iterated complex value at c, so its derivative with respect to c begins at 1
+    complex z  = c;
+    complex dz = { 1.0, 0.0 };
+    double  abs_squared = c.real * c.real + c.imag * c.imag;
+
+    // This is the magnitude (squared) of the derivative of z with respect to where it started
+    double dz0_abs_squared = 1.0;
+
+    // So far we've done no iterations
+    int iter = 0;
+
+    // Iterate on z^2 + c...
+    while (iter < (int)max_iter)
+    {
+        // Keep track of how many iterations we do
+        ++iter;
+
+        // Compute the new values of 'dz' and 'z', and of the other derivative's magnitude
+        dz0_abs_squared *= 4 * abs_squared;
+        dz = derivative_step(z, dz, 1);
+        z  = square_and_add(z, c);
+        abs_squared = z.real * z.real + z.imag * z.imag;
+
+        // If our new point has gone out of bounds, keep track of how long it took
+        if (abs_squared >= 4.0)
+        {
+            dz = derivative_step(z, dz, 1);
+            z  = square_and_add(z, c);
+            dz = derivative_step(z, dz, 1);
+            z  = square_and_add(z, c);
+
+            abs_squared = z.real * z.real + z.imag * z.imag;
 
-            return{ iter, abs_squared };
+            return{ iter, iter, abs_squared, distance_estimate(z, dz) };
         }
+
+        // If the derivative has collapsed, the orbit has been drawn into an attracting cycle
+        if (dz0_abs_squared < INTERIOR_THRESHOLD) return{ 0, iter, 0.0, interior ? interior_estimate(z, c) : 0.0 };
     }
 
     // We never exceeded the escape radius
-    return{ 0 , 0.0 };
+    return{ 0, iter, 0.0, 0.0 };
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// IteratorDE_Mandelbrot() - Iterator for the Mandlebrot set that also estimates the distance to the set
+//                           from points outside it
+//=========================================================================================================
+escape IteratorDE_Mandelbrot(double real, double imag, U32 max_iter)
+{
+    return iterate_de_mandelbrot(real, imag, max_iter, false);
 }
 //=========================================================================================================
 
 
+//=========================================================================================================
+// IteratorDEI_Mandelbrot() - Iterator for the Mandlebrot set that estimates the distance to the boundary
+//                            from points on both sides of it.  Searching for the period of an interior
+//                            point's cycle is expensive, so only the color scheme that shades the inside
+//                            of the set uses this
+//=========================================================================================================
+escape IteratorDEI_Mandelbrot(double real, double imag, U32 max_iter)
+{
+    return iterate_de_mandelbrot(real, imag, max_iter, true);
+}
+//=========================================================================================================
+
 
 
 //=========================================================================================================
 // Iterator_Julia01() - Iterator for Julia Set #1
 //=========================================================================================================
-escape Iterator_Julia01(double real, double imag)
+escape Iterator_Julia01(double real, double imag, U32 max_iter)
 {
     complex z = { real, imag };
     complex c = { -0.8,  0.156 };
-  
+    double  abs_squared = z.real * z.real + z.imag * z.imag;
+
+    // This is the magnitude (squared) of the derivative of z with respect to where it started
+    double dz_abs_squared = 1.0;
+
     // So far we've done no iterations
     int iter = 0;
 
     // Iterate on z^2 + c...
-    while (iter < (int)dwell)
+    while (iter < (int)max_iter)
     {
         // Keep track of how many iterations we do
         ++iter;
 
-        // Compute the new value of 'z'
+        // Compute the new value of 'z', and of the derivative's magnitude
+        dz_abs_squared *= 4 * abs_squared;
         z = square_and_add(z, c);
+        abs_squared = z.real * z.real + z.imag * z.imag;
 
         // If our new point has gone out of bounds, keep track of how long it took
-        if ((z.real * z.real + z.imag * z.imag) >= 4.0)
+        if (abs_squared >= 4.0)
         {
             z = square_and_add(z, c);
             z = square_and_add(z, c);
 
+            abs_squared = z.real * z.real + z.imag * z.imag;
+
+            return{ iter, iter, abs_squared, 0.0 };
+        }
+
+        // If the derivative has collapsed, the orbit has been drawn into an attracting cycle
+        if (dz_abs_squared < INTERIOR_THRESHOLD) break;
+    }
+
+    // We never exceeded the escape radius
+    return{ 0, iter, 0.0, 0.0 };
+}
+//=========================================================================================================
+
+
+
+//=========================================================================================================
+// IteratorDE_Julia01() - Iterator for Julia Set #1 that also tracks the derivative dz/dz0, to estimate
+//                        the distance to the set
+//=========================================================================================================
+escape IteratorDE_Julia01(double real, double imag, U32 max_iter)
+{
+    complex z  = { real, imag };
+    complex c  = { -0.8,  0.156 };
+    complex dz = { 1.0, 0.0 };
+
+    // So far we've done no iterations
+    int iter = 0;
+
+    // Iterate on z^2 + c...
+    while (iter < (int)max_iter)
+    {
+        // Keep track of how many iterations we do
+        ++iter;
+
+        // Compute the new values of 'dz' and 'z'
+        dz = derivative_step(z, dz, 0);
+        z  = square_and_add(z, c);
+
+        // If our new point has gone out of bounds, keep track of how long it took
+        if ((z.real * z.real + z.imag * z.imag) >= 4.0)
+        {
+            dz = derivative_step(z, dz, 0);
+            z  = square_and_add(z, c);
+            dz = derivative_step(z, dz, 0);
+            z  = square_and_add(z, c);
+
             double abs_squared = z.real * z.real + z.imag * z.imag;
 
-            return{ iter, abs_squared };
+            return{ iter, iter, abs_squared, distance_estimate(z, dz) };
         }
+
+        // If the derivative has collapsed, the orbit has been drawn into an attracting cycle
+        if ((dz.real * dz.real + dz.imag * dz.imag) < INTERIOR_THRESHOLD) break;
     }
 
     // We never exceeded the escape radius
-    return{ 0 , 0.0 };
+    return{ 0, iter, 0.0, 0.0 };
 }
 //=========================================================================================================
 
@@ -164,8 +480,27 @@ void CPlotter::Start(char command)
 //=========================================================================================================
 void CPlotter::StartPanel(char command)
 {
-    // This is the next column number that will be issued for plotting
-    m_next_column = 0;
+    // This is the next unit of work that will be issued for plotting
+    m_next_unit = 0;
+
+    // This is the next tile number that will be issued for recoloring
+    m_next_tile = 0;
+
+    // Pick the shading pipeline for the current color scheme and shading options
+    Shader.SelectPipeline();
+
+    // Find out whether this panel can make use of the symmetry of the fractal, and decide what order to
+    // plot its columns in
+    if (command == MT_PLOT)
+    {
+        FindSymmetry();
+        PlanWork();
+    }
+
+    // Note when the plotting threads got started
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    m_panel_start = now.QuadPart;
 
     for (U32 i=0; i<cpu_count; ++i) Plotter[i].Start(command);
 }
@@ -186,12 +521,18 @@ void CPlotter::SetFractal(U32 fractal)
     switch (fractal)
     {
     case 0:
-        Iterator = Iterator_Mandelbrot;
+        Iterator    = Iterator_Mandelbrot;
+        IteratorDE  = IteratorDE_Mandelbrot;
+        IteratorDEI = IteratorDEI_Mandelbrot;
+        m_fractal_symmetry = SYM_CONJUGATE;
         coord_stack.push(mandelbrot);
         break;
 
     case 1:
-        Iterator = Iterator_Julia01;
+        Iterator    = Iterator_Julia01;
+        IteratorDE  = IteratorDE_Julia01;
+        IteratorDEI = IteratorDE_Julia01;   // This Julia set has no interior estimate
+        m_fractal_symmetry = SYM_ROTATE;
         coord_stack.push(julia);
         break;
     }
@@ -200,6 +541,19 @@ void CPlotter::SetFractal(U32 fractal)
 
 
 
+//=========================================================================================================
+// EstimatesDistance() - Returns true if plotting with the current settings estimates the distance to the
+//                       set.  The distance-estimation color scheme needs the estimates, and oversampled
+//                       plots use them to skip supersampling pixels that are far from the set
+//=========================================================================================================
+bool CPlotter::EstimatesDistance()
+{
+    return ps.oversample > 1 || Shader.GetScheme() == CS_DEM;
+}
+//=========================================================================================================
+
+
+
 //=========================================================================================================
 // ThreadsCompleted() - Returns the number of threads that have completed their tasks
 //=========================================================================================================
@@ -219,27 +573,215 @@ U32 CPlotter::ThreadsCompleted()
 
 
 //=========================================================================================================
-// IssueColumn() - Returns the number of the next column that required plotting
+// PlanWork() - Decides what order the columns of the panel get plotted in.  The cost of a column can vary
+//              by orders of magnitude between the exterior of the set and its boundary, and a thread that
+//              picks up an expensive column last holds up the whole panel while the others sit idle.
+//              So the cost of each group of columns is predicted from a handful of points, and the most
+//              expensive columns are handed out first.  A column that is expensive enough to hold up the
+//              panel on its own is split into ranges of rows that separate threads can share
 //
-// Note: Column number returned is *relative to the current panel*
+// Note: Column numbers in the work list are *relative to the current panel*
+//=========================================================================================================
+void CPlotter::PlanWork()
+{
+    U32 cols = ps.cols_this_panel;
+    U32 rows = ps.rows_this_panel;
+
+    // Start with an empty list of work
+    m_work.clear();
+
+    // Determine the left-most real coordinate in the render
+    double min_real = ps.coord.center.real - ps.coord.span.real / 2;
+
+    // This is how many groups of columns there are, and how many points of each we probe
+    U32 groups = (cols + COST_GROUP_WIDTH - 1) / COST_GROUP_WIDTH;
+    U32 probes = (rows < COST_PROBE_ROWS) ? rows : COST_PROBE_ROWS;
+
+    // Find the points we probe: evenly spaced down the middle column of each group
+    vector<complex> points;
+    points.reserve((size_t)groups * probes);
+    for (U32 g=0; g<groups; ++g)
+    {
+        U32 first_col = g * COST_GROUP_WIDTH;
+        U32 width     = (cols - first_col < COST_GROUP_WIDTH) ? cols - first_col : COST_GROUP_WIDTH;
+        double real   = min_real + ps.pixel_size * (ps.panel_left + first_col + width / 2);
+
+        for (U32 p=0; p<probes; ++p)
+        {
+            complex c = {real, imaginary[(2 * p + 1) * rows / (2 * probes)]};
+            points.push_back(c);
+        }
+    }
+
+    // Have the plotter threads iterate them
+    vector<escape> results;
+    IteratePoints(points, ps.dwell, results);
+
+    // If we're aborting, there's no work to hand out
+    if (aborting) return;
+
+    // Predict the cost (in iterations per pixel) of each group of columns from the iterations its probes
+    // actually took, whether they escaped or were found to be inside the set
+    vector<double> cost(groups);
+    double total_cost = 0;
+    for (U32 g=0; g<groups; ++g)
+    {
+        U32 first_col = g * COST_GROUP_WIDTH;
+        U32 width     = (cols - first_col < COST_GROUP_WIDTH) ? cols - first_col : COST_GROUP_WIDTH;
+
+        double sum = 0;
+        for (U32 p=0; p<probes; ++p) sum += results[(size_t)g * probes + p].work;
+
+        cost[g] = sum / probes;
+        total_cost += cost[g] * rows * width;
+    }
+
+    // Put the groups in order, most expensive first
+    vector<U32> order(groups);
+    for (U32 g=0; g<groups; ++g) order[g] = g;
+    std::stable_sort(order.begin(), order.end(), [&](U32 a, U32 b) {return cost[a] > cost[b];});
+
+    // No unit of work should cost more than this.  Splitting a column costs us whatever its symmetry
+    // would have saved, so columns are only split when the panel has no symmetry to make use of
+    double share = total_cost / cpu_count / COST_SHARE;
+    bool can_split = (m_symmetry == SYM_NONE);
+
+    // Build the list of work
+    for (U32 g : order)
+    {
+        U32 last_col = (g + 1) * COST_GROUP_WIDTH;
+        if (last_col > cols) last_col = cols;
+
+        for (U32 col = g * COST_GROUP_WIDTH; col < last_col; ++col)
+        {
+            // Figure out how many pieces this column gets split into
+            U32 pieces = 1;
+            double column_cost = cost[g] * rows;
+            if (can_split && share > 0 && column_cost > share)
+            {
+                pieces = (U32)ceil(column_cost / share);
+                if (pieces > rows / MIN_SPLIT_ROWS) pieces = rows / MIN_SPLIT_ROWS;
+                if (pieces < 1) pieces = 1;
+            }
+
+            // And add each piece to the list
+            for (U32 i=0; i<pieces; ++i)
+            {
+                work_unit unit;
+                unit.col       = col;
+                unit.first_row = (U32)((U64)rows * i / pieces);
+                unit.row_count = (U32)((U64)rows * (i + 1) / pieces) - unit.first_row;
+                m_work.push_back(unit);
+            }
+        }
+    }
+}
+//=========================================================================================================
+
+
 //=========================================================================================================
-int CPlotter::IssueColumn()
+// IssueWork() - Returns the index (in m_work) of the next unit of work that requires plotting, or -1 if
+//               there are none left
+//=========================================================================================================
+int CPlotter::IssueWork()
 {
     static CCriticalSection cs;
   
-    // Assume for the moment that we are out of column numbers
+    // Assume for the moment that we are out of work
+    int result = -1;
+
+    // Only one thread at a time is allowed to request a new unit of work
+    cs.Lock();
+
+    // If there is a unit of work available, it's our result
+    if (m_next_unit < m_work.size()) result = m_next_unit++;
+
+    // Allow other threads to run this routine
+    cs.Unlock();
+
+    // Hand the caller its unit of work
+    return result;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// TallyIdleTime() - Adds up the time that each thread sat idle, between running out of work on the
+//                   panel and the last thread finishing it
+//=========================================================================================================
+void CPlotter::TallyIdleTime()
+{
+    // Find out when the last thread finished
+    U64 last = m_panel_start;
+    for (U32 i=0; i<cpu_count; ++i) if (Plotter[i].m_finish_time > last) last = Plotter[i].m_finish_time;
+
+    // Every thread was idle from the time it finished until then
+    for (U32 i=0; i<cpu_count; ++i)
+    {
+        if (Plotter[i].m_finish_time > m_panel_start) m_idle_ticks += last - Plotter[i].m_finish_time;
+    }
+
+    // And every thread was tied up with this panel the whole time
+    m_thread_ticks += (last - m_panel_start) * cpu_count;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ResetStats() - Resets the idle-time statistics
+//=========================================================================================================
+void CPlotter::ResetStats()
+{
+    m_idle_ticks   = 0;
+    m_thread_ticks = 0;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// GetStats() - Fetches the time that threads have spent idle at the ends of panels
+//=========================================================================================================
+void CPlotter::GetStats(double* idle_seconds, double* idle_fraction)
+{
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceFrequency(&frequency);
+
+    *idle_seconds  = (double)m_idle_ticks / frequency.QuadPart / cpu_count;
+    *idle_fraction = m_thread_ticks ? (double)m_idle_ticks / m_thread_ticks : 0.0;
+}
+//=========================================================================================================
+
+
+
+
+//=========================================================================================================
+// IssueTile() - Returns the number of the next escape-data tile that requires recoloring, or -1 if
+//               there are none left
+//
+// Note: Tile number returned is *relative to the current panel*
+//=========================================================================================================
+int CPlotter::IssueTile()
+{
+    static CCriticalSection cs;
+
+    // How many tiles across and down is this panel?
+    U32 across = (ps.cols_this_panel + ESCAPE_TILE_SIZE - 1) / ESCAPE_TILE_SIZE;
+    U32 down   = (ps.rows_this_panel + ESCAPE_TILE_SIZE - 1) / ESCAPE_TILE_SIZE;
+
+    // Assume for the moment that we are out of tiles
     int result = -1;
 
-    // Only one thread at a time is allowed to request a new column number
+    // Only one thread at a time is allowed to request a new tile number
     cs.Lock();
 
-    // If there is a column number available, it's our result
-    if (m_next_column < ps.cols_this_panel) result = m_next_column++;
+    // If there is a tile number available, it's our result
+    if (m_next_tile < across * down) result = m_next_tile++;
 
     // Allow other threads to run this routine
     cs.Unlock();
 
-    // Hand the caller his column number
+    // Hand the caller his tile number
     return result;
 }
 //=========================================================================================================
@@ -259,21 +801,34 @@ void CPlotter::NotifyComplete()
 //=========================================================================================================
 
 //=========================================================================================================
-// Reshade() - Reshades the viewport window
+// GetViewportRows() - Determines which rows of the viewport this thread is responsible for when the
+//                     threads split the viewport between them
 //=========================================================================================================
-void CPlotter::Reshade()
+void CPlotter::GetViewportRows(U32* first_row, U32* row_count)
 {
-    // Figure out how many rows each thread needs to reshade
-    int rows_per_thread = VIEWPORT_SIZE / cpu_count;
+    // Figure out how many rows each thread is responsible for
+    U32 rows_per_thread = VIEWPORT_SIZE / cpu_count;
 
     // Determine which row is the first row this thread should operate on
-    int first_row = m_ID * rows_per_thread;
+    *first_row = m_ID * rows_per_thread;
+
+    // The last thread picks up whatever rows are left over
+    *row_count = ((U32)m_ID == cpu_count - 1) ? VIEWPORT_SIZE - *first_row : rows_per_thread;
+}
+//=========================================================================================================
+
+//=========================================================================================================
+// Reshade() - Reshades the viewport window
+//=========================================================================================================
+void CPlotter::Reshade()
+{
+    U32 first_row, rows_this_thread;
 
-    // Figure out how many rows this thread is responsible for reshading
-    int rows_this_thread = (m_ID == cpu_count - 1) ? VIEWPORT_SIZE - first_row : rows_per_thread;
+    // Figure out which rows this thread is responsible for reshading
+    GetViewportRows(&first_row, &rows_this_thread);
 
     // This is the total number of elements this thread is responsible for reshading
-    int total_elements = rows_this_thread * VIEWPORT_SIZE;
+    U32 total_elements = rows_this_thread * VIEWPORT_SIZE;
 
     // Point to the first fractal row that this thread is responsible for
     frac_value* fvp = fractal + first_row * VIEWPORT_SIZE;
@@ -282,7 +837,7 @@ void CPlotter::Reshade()
     pixel* pxp = viewport + first_row * VIEWPORT_SIZE;
 
     // Reshade all of the pixels we are responsible for
-    while (total_elements--) *pxp++ = Shader.GetColor(*fvp++);
+    Shader.GetColors(fvp, pxp, total_elements);
 }
 //=========================================================================================================
 
@@ -291,123 +846,825 @@ void CPlotter::Reshade()
 
 
 //=========================================================================================================
-// Main() - Computes particle paths through the complex plane
+// Recolor() - Shades the current panel from the samples in the escape-data file.  The panel must start
+//             on a tile boundary of the escape-data file
 //=========================================================================================================
-void CPlotter::Main(int P1, int P2, int P3)
-{   
-    char   command;
-    frac_value value;
+void CPlotter::Recolor()
+{
+    const U32  T = ESCAPE_TILE_SIZE;
+    // This is how many samples there are per pixel
+    U32 spp = ps.oversample ? ps.oversample : 1;
 
-WaitForCommand:
+    // Make room for a row of a tile's worth of fractal values
+    m_values.resize(T);
 
-    // Wait for a new command to arrive
-    ReadFile(m_hread_cmd, &command, 1, nullptr, nullptr);
+    // How many tiles across is this panel?
+    U32 across = (ps.cols_this_panel + T - 1) / T;
 
-    // If we're just reshading, do so
-    if (command == MT_RESHADE)
+    // Make sure we have room to decode a full tile
+    m_tile.resize((size_t)T * T * spp);
+    escape_sample* samples = m_tile.data();
+
+    // Keep fetching tiles until there are none left
+    for (int tile = IssueTile(); tile >= 0 && !aborting; tile = IssueTile())
     {
-        Reshade();
-        NotifyComplete();
-        goto WaitForCommand;
+        // Find the upper-left corner of this tile within the panel
+        U32 x0 = (tile % across) * T;
+        U32 y0 = (tile / across) * T;
+
+        // Find out how much of this tile lies inside the panel
+        U32 cols = ps.cols_this_panel - x0;
+        U32 rows = ps.rows_this_panel - y0;
+        if (cols > T) cols = T;
+        if (rows > T) rows = T;
+
+        // Read and decode the tile.  If it's damaged, the render can't be recolored, so stop
+        if (!EscapeReader.ReadTile((ps.panel_left + x0) / T, (ps.panel_top + y0) / T, samples))
+        {
+            m_read_failed = true;
+            aborting      = true;
+            break;
+        }
+
+        // Loop through each row of the tile...
+        for (U32 y=0; y<rows; ++y)
+        {
+            // Point to the first sample of this row of the tile
+            const escape_sample* p_sample = samples + (U64)y * T * spp;
+
+            // Point to where the first pixel of this row goes in the panel
+            pixel* p_pixel = ps.bitmap + (U64)(y0 + y) * ps.cols_this_panel + x0;
+
+            // Fetch the fractal value of each pixel in this row
+            for (U32 x=0; x<cols; ++x)
+            {
+                for (U32 i=0; i<spp; ++i)
+                {
+                    m_values[x].e[i].iter     = p_sample->iter;
+                    m_values[x].e[i].distance = p_sample->distance;
+                    m_values[x].e[i].estimate = 0;
+                    ++p_sample;
+                }
+            }
+
+            // And shade the whole row
+            Shader.GetColors(m_values.data(), p_pixel, cols);
+        }
+
+        // Keep track of how many pixels we've completed
+        pixels_completed_cs.Lock();
+        pixels_completed += cols * rows;
+        pixels_completed_cs.Unlock();
+    }
+}
+//=========================================================================================================
+
+
+
+
+
+//=========================================================================================================
+// BuildHistogram() - Builds the histogram of escape counts that histogram-equalized shading needs, and
+//                    hands it to the shader
+//
+// Every thread counts its share of the samples into a histogram of its own, so the threads never
+// contend for the bins.  The histograms are then merged in parallel: each thread sums a range of the
+// bins across all of the threads' histograms
+//=========================================================================================================
+void CPlotter::BuildHistogram(char command, U32 max_iter)
+{
+    U32 i;
+
+    // There's a bin for every escape count up to "max_iter", unless that's too many, in which case each
+    // bin counts a range of escape counts
+    U64 counts = (U64)max_iter + 1;
+    m_histogram_width = (U32)((counts + MAX_HISTOGRAM_BINS - 1) / MAX_HISTOGRAM_BINS);
+    m_histogram_bins  = (U32)((counts + m_histogram_width - 1) / m_histogram_width);
+
+    // Make room for the merged histogram
+    m_merged_histogram.assign(m_histogram_bins, 0);
+
+    // Have every thread count its share of the samples
+    for (i=0; i<cpu_count; ++i) Plotter[i].Start(command);
+    for (i=0; i<cpu_count; ++i) Plotter[i].Wait();
+
+    // Then have them merge their histograms together
+    for (i=0; i<cpu_count; ++i) Plotter[i].Start(MT_MERGE_HISTOGRAM);
+    for (i=0; i<cpu_count; ++i) Plotter[i].Wait();
+
+    // And tell the shader what the distribution of escape counts looks like
+    Shader.SetHistogram(m_merged_histogram, m_histogram_width);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CountViewport() - Counts the escape counts of this thread's share of the viewport
+//=========================================================================================================
+void CPlotter::CountViewport()
+{
+    U32 first_row, rows_this_thread;
+
+    // This thread is responsible for the same rows that "Reshade()" is
+    GetViewportRows(&first_row, &rows_this_thread);
+
+    // This is how many samples there are per pixel
+    U32 spp = ps.oversample ? ps.oversample : 1;
+
+    // Start with an empty histogram
+    m_histogram.assign(m_histogram_bins, 0);
+
+    // Count every sample of every pixel we're responsible for
+    const frac_value* fvp = fractal + first_row * VIEWPORT_SIZE;
+    for (U32 n = rows_this_thread * VIEWPORT_SIZE; n; --n, ++fvp)
+    {
+        for (U32 i=0; i<spp; ++i) Count(fvp->e[i].iter);
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Prepass() - Plots this thread's share of the rows of a low-resolution copy of the render, counting
+//             the escape counts.  This gives a full render the histogram before any panel is plotted,
+//             so that each panel can be shaded as soon as it's done
+//=========================================================================================================
+void CPlotter::Prepass()
+{
+    // The prepass is PREPASS_SIZE pixels along its longer side, in the same proportions as the render
+    U32 cols = PREPASS_SIZE, rows = PREPASS_SIZE;
+    if (ps.columns >= ps.rows)
+        rows = (U32)((U64)PREPASS_SIZE * ps.rows / ps.columns);
+    else
+        cols = (U32)((U64)PREPASS_SIZE * ps.columns / ps.rows);
+    if (rows == 0) rows = 1;
+    if (cols == 0) cols = 1;
+
+    // Find the upper-left corner of the render, and the size of a prepass pixel
+    double min_real = ps.coord.center.real - ps.coord.span.real / 2;
+    double max_imag = ps.coord.center.imag + ps.coord.span.imag / 2;
+    double step_x   = ps.coord.span.real / cols;
+    double step_y   = ps.coord.span.imag / rows;
+
+    // Start with an empty histogram
+    m_histogram.assign(m_histogram_bins, 0);
+
+    // The threads take turns with the rows, plotting a single sample in the center of each pixel.  Each
+    // sample gets the dwell limit of the panel it lies in, so it escapes (or doesn't) just as it will
+    // when that panel is plotted
+    for (U32 y = m_ID; y < rows && !aborting; y += cpu_count)
+    {
+        double imag  = max_imag - step_y * (y + 0.5);
+        U32    row   = (U32)((y + 0.5) * ps.rows / rows);
+        for (U32 x=0; x<cols; ++x)
+        {
+            U32 limit = panel_dwell[PanelAt((U32)((x + 0.5) * ps.columns / cols), row)];
+            Count(Iterator(min_real + step_x * (x + 0.5), imag, limit).iter);
+        }
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// PrepassEscapeData() - Counts the escape counts in this thread's share of a sampling of the tiles of
+//                       the escape-data file.  This gives a recolor the histogram before any panel is
+//                       shaded
+//=========================================================================================================
+void CPlotter::PrepassEscapeData()
+{
+    const U32 T = ESCAPE_TILE_SIZE;
+    const ESCAPEHDR& hdr = EscapeReader.Header();
+
+    // Spread the tiles we're going to decode evenly through the file
+    U32 tile_count = hdr.tiles_across * hdr.tiles_down;
+    U32 step       = (tile_count > PREPASS_TILES) ? tile_count / PREPASS_TILES : 1;
+
+    // Make sure we have room to decode a full tile
+    U32 spp = hdr.samples_per_pixel;
+    m_tile.resize((size_t)T * T * spp);
+
+    // Start with an empty histogram
+    m_histogram.assign(m_histogram_bins, 0);
+
+    // The threads take turns with the tiles
+    for (U32 n = m_ID * step; n < tile_count && !aborting; n += cpu_count * step)
+    {
+        U32 tile_x = n % hdr.tiles_across;
+        U32 tile_y = n / hdr.tiles_across;
+
+        // Read and decode the tile.  If it's damaged, the render can't be recolored, so stop
+        if (!EscapeReader.ReadTile(tile_x, tile_y, m_tile.data()))
+        {
+            m_read_failed = true;
+            aborting      = true;
+            break;
+        }
+
+        // Find out how much of this tile lies inside the image
+        U32 cols = hdr.cols - tile_x * T;
+        U32 rows = hdr.rows - tile_y * T;
+        if (cols > T) cols = T;
+        if (rows > T) rows = T;
+
+        // And count every sample in it
+        for (U32 y=0; y<rows; ++y)
+        {
+            const escape_sample* p_sample = m_tile.data() + (U64)y * T * spp;
+            for (U32 i = cols * spp; i; --i) Count((p_sample++)->iter);
+        }
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// IteratePoints() - Iterates a list of points, and stores the escape value of each one
+//=========================================================================================================
+void CPlotter::IteratePoints(const vector<complex>& points, U32 max_iter, vector<escape>& results)
+{
+    U32 i;
+
+    // Tell the threads what to iterate.  Points that don't get iterated (because we're aborting) look
+    // like they never escaped, and took no work
+    escape none = {0, 0, 0.0, 0.0};
+    m_points        = &points;
+    m_points_limit  = max_iter;
+    m_points_result = &results;
+    results.assign(points.size(), none);
+
+    // And have every thread iterate its share of them
+    for (i=0; i<cpu_count; ++i) Plotter[i].Start(MT_ITERATE_POINTS);
+    for (i=0; i<cpu_count; ++i) Plotter[i].Wait();
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// IterateShare() - Iterates this thread's share of the points handed to "IteratePoints()"
+//=========================================================================================================
+void CPlotter::IterateShare()
+{
+    const vector<complex>& points = *m_points;
+    vector<escape>&        results = *m_points_result;
+
+    // The threads take turns with the points
+    for (size_t i = m_ID; i < points.size() && !aborting; i += cpu_count)
+    {
+        results[i] = Iterator(points[i].real, points[i].imag, m_points_limit);
     }
+}
+//=========================================================================================================
 
-    // Compute the pixel number at the left hand edge of this panel
-    U32 panel_left_x = ps.panel_number * ps.panel_width;
 
+//=========================================================================================================
+// MergeHistogram() - Sums this thread's share of the bins across the histograms of all of the threads
+//=========================================================================================================
+void CPlotter::MergeHistogram()
+{
+    // Figure out which range of bins this thread is responsible for
+    U32 bins_per_thread = (m_histogram_bins + cpu_count - 1) / cpu_count;
+    U32 first = m_ID * bins_per_thread;
+    U32 last  = first + bins_per_thread;
+    if (last > m_histogram_bins) last = m_histogram_bins;
+
+    // Add up the bins across every thread's histogram
+    for (U32 t=0; t<cpu_count; ++t)
+    {
+        const vector<U64>& histogram = Plotter[t].m_histogram;
+        for (U32 n=first; n<last; ++n) m_merged_histogram[n] += histogram[n];
+    }
+}
+//=========================================================================================================
+
+
+
+
+
+//=========================================================================================================
+// PrepareCycle() - Prepares the viewport for color cycling.  Computing an escape value takes a couple of
+//                  logarithms, so it's done once here for every sample, and the result is kept as a
+//                  16-bit index into the shader's color-cycling lookup table.  Every frame after that is
+//                  a table lookup per sample
+//=========================================================================================================
+void CPlotter::PrepareCycle()
+{
+    U32 i;
+
+    // Make room for the index of every sample in the viewport
+    U32 spp = ps.oversample ? ps.oversample : 1;
+    m_cycle_index.resize((size_t)VIEWPORT_PIXELS * spp);
+
+    // Have every thread find the range of escape values in its share of the viewport
+    for (i=0; i<cpu_count; ++i) Plotter[i].Start(MT_CYCLE_RANGE);
+    for (i=0; i<cpu_count; ++i) Plotter[i].Wait();
+
+    // Combine them into the range of escape values in the whole viewport
+    double lo = Plotter[0].m_cycle_lo, hi = Plotter[0].m_cycle_hi;
+    for (i=1; i<cpu_count; ++i)
+    {
+        if (Plotter[i].m_cycle_lo < lo) lo = Plotter[i].m_cycle_lo;
+        if (Plotter[i].m_cycle_hi > hi) hi = Plotter[i].m_cycle_hi;
+    }
+
+    // If nothing in the viewport escaped, any range will do
+    if (lo > hi) lo = hi = 0;
+
+    // Spread the lookup table across that range
+    Shader.BuildCycleLut(lo, hi);
+
+    // And have every thread convert its escape values to table indices
+    for (i=0; i<cpu_count; ++i) Plotter[i].Start(MT_CYCLE_INDEX);
+    for (i=0; i<cpu_count; ++i) Plotter[i].Wait();
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CycleFrame() - Shades a frame of color cycling into the viewport
+//=========================================================================================================
+void CPlotter::CycleFrame(U32 shift)
+{
+    U32 i;
+
+    m_cycle_shift = shift;
+    for (i=0; i<cpu_count; ++i) Plotter[i].Start(MT_CYCLE);
+    for (i=0; i<cpu_count; ++i) Plotter[i].Wait();
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CycleRange() - Finds the range of escape values in this thread's share of the viewport
+//=========================================================================================================
+void CPlotter::CycleRange()
+{
+    U32 first_row, row_count;
+
+    // Figure out which rows of the viewport are ours
+    GetViewportRows(&first_row, &row_count);
+
+    // This is how many samples there are per pixel
+    U32 spp = ps.oversample ? ps.oversample : 1;
+
+    // Make room for the escape values of a batch of pixels
+    m_escape_values.resize(SHADE_BATCH * spp);
+    double* d = m_escape_values.data();
+
+    // We haven't seen any escape values yet
+    m_cycle_lo = DBL_MAX;
+    m_cycle_hi = -DBL_MAX;
+
+    // Compute the escape values a batch at a time, and keep track of the smallest and largest
+    const frac_value* fvp = fractal + first_row * VIEWPORT_SIZE;
+    for (U32 count = row_count * VIEWPORT_SIZE; count;)
+    {
+        U32 n = (count < SHADE_BATCH) ? count : SHADE_BATCH;
+        Shader.GetEscapeValues(fvp, n, d);
+        for (U32 k=0; k<n * spp; ++k)
+        {
+            if (fvp[k / spp].e[k % spp].iter <= 0) continue;
+            if (d[k] < m_cycle_lo) m_cycle_lo = d[k];
+            if (d[k] > m_cycle_hi) m_cycle_hi = d[k];
+        }
+        fvp   += n;
+        count -= n;
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// CycleIndex() - Converts the escape values of this thread's share of the viewport to color-cycling
+//                lookup table indices
+//=========================================================================================================
+void CPlotter::CycleIndex()
+{
+    U32 first_row, row_count;
+
+    // Figure out which rows of the viewport are ours
+    GetViewportRows(&first_row, &row_count);
+
+    // This is how many samples there are per pixel
+    U32 spp = ps.oversample ? ps.oversample : 1;
+
+    // Point to our share of the fractal values, and to where their indices go
+    const frac_value* fvp = fractal + first_row * VIEWPORT_SIZE;
+    U16* index = m_cycle_index.data() + (size_t)first_row * VIEWPORT_SIZE * spp;
+    double* d  = m_escape_values.data();
+
+    // Compute the escape values a batch at a time, and convert them to indices
+    for (U32 count = row_count * VIEWPORT_SIZE; count;)
+    {
+        U32 n = (count < SHADE_BATCH) ? count : SHADE_BATCH;
+        Shader.GetEscapeValues(fvp, n, d);
+        for (U32 k=0; k<n * spp; ++k)
+        {
+            *index++ = (fvp[k / spp].e[k % spp].iter <= 0) ? CYCLE_INTERIOR : Shader.CycleIndex(d[k]);
+        }
+        fvp   += n;
+        count -= n;
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Cycle() - Shades this thread's share of the viewport for a frame of color cycling
+//=========================================================================================================
+void CPlotter::Cycle()
+{
+    U32 first_row, row_count;
+
+    // Figure out which rows of the viewport are ours
+    GetViewportRows(&first_row, &row_count);
+
+    // This is how many samples there are per pixel
+    U32 spp = ps.oversample ? ps.oversample : 1;
+
+    // Shade our rows straight from their lookup table indices
+    const U16* index = m_cycle_index.data() + (size_t)first_row * VIEWPORT_SIZE * spp;
+    Shader.CycleColors(index, viewport + first_row * VIEWPORT_SIZE, row_count * VIEWPORT_SIZE, m_cycle_shift);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// FindSymmetry() - Determines whether the current panel can make use of the symmetry of the fractal.
+//                  That's the case when the pixel grid is itself symmetric about the real axis (and for
+//                  rotational symmetry, about the imaginary axis too), so that every pixel whose mirror
+//                  image lies in the panel lands exactly on another pixel
+//=========================================================================================================
+void CPlotter::FindSymmetry()
+{
+    // Assume for the moment that we can't use any symmetry
+    m_symmetry = SYM_NONE;
+    if (m_fractal_symmetry == SYM_NONE) return;
+
+    // Image rows y and y' have opposite imaginary values when y + y' is this.  It has to be a whole
+    // number, and small enough that some rows actually mirror each other
+    double max_imag = ps.coord.center.imag + ps.coord.span.imag / 2;
+    double row_sum  = 2 * max_imag * ps.rows / ps.coord.span.imag;
+    if (fabs(row_sum - floor(row_sum + 0.5)) > 1e-6 || row_sum < 1 || row_sum > 2.0 * ps.rows) return;
+    m_mirror_row_sum = (int)floor(row_sum + 0.5);
+
+    // Rotational symmetry needs the same of the columns
+    if (m_fractal_symmetry == SYM_ROTATE)
+    {
+        double min_real = ps.coord.center.real - ps.coord.span.real / 2;
+        double col_sum  = -2 * min_real / ps.pixel_size;
+        if (fabs(col_sum - floor(col_sum + 0.5)) > 1e-6 || col_sum < 1 || col_sum > 2.0 * ps.columns) return;
+        m_mirror_col_sum = (int)floor(col_sum + 0.5);
+    }
+
+    // This panel can make use of the fractal's symmetry
+    m_symmetry = m_fractal_symmetry;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// MirrorValue() - Turns the fractal value of a pixel into the fractal value of its mirror image.  The
+//                 escape values are the same, but the samples within the pixel are mirrored too
+//=========================================================================================================
+void CPlotter::MirrorValue(frac_value& value, int symmetry)
+{
+    escape* e = value.e;
+
+    // The samples of a 4X pixel are (-,-), (-,+), (+,-), (+,+).  The samples of a 9X pixel are three
+    // rows of three, from the most negative imaginary offset to the most positive
+    if (symmetry == SYM_CONJUGATE)
+    {
+        if (ps.oversample == 4) {std::swap(e[0], e[1]); std::swap(e[2], e[3]);}
+        if (ps.oversample == 9) {std::swap(e[0], e[6]); std::swap(e[1], e[7]); std::swap(e[2], e[8]);}
+    }
+    else
+    {
+        if (ps.oversample == 4) {std::swap(e[0], e[3]); std::swap(e[1], e[2]);}
+        if (ps.oversample == 9) for (int i=0; i<4; ++i) std::swap(e[i], e[8 - i]);
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// BeginPlot() - Gets this thread ready to plot a panel
+//=========================================================================================================
+void CPlotter::BeginPlot()
+{
     // Determine how wide 1/4 of a pixel is
-    double quarter_pixel = ps.pixel_size / 4;
+    m_quarter_pixel = ps.pixel_size / 4;
+
+    // Determine the left-most real coordinate in the render
+    m_min_real = ps.coord.center.real - ps.coord.span.real / 2;
+
+    // Make room for the fractal values and colors of a column
+    m_column.resize(ps.rows_this_panel);
+    m_colors.resize(ps.rows_this_panel);
+
+    // If we're estimating distances, we use the iterator that tracks the derivative.  Only the
+    // distance-estimation color scheme shades the inside of the set, so only it pays for interior estimates
+    bool estimate = EstimatesDistance();
+    m_iterate = estimate ? IteratorDE : Iterator;
+    if (Shader.GetScheme() == CS_DEM) m_iterate = IteratorDEI;
+
+    // This is the dwell limit for this panel
+    m_dwell = ps.dwell;
+
+    // When oversampling with distance estimates, a pixel whose center is more than a pixel width from
+    // the set looks the same however it's sampled, so only pixels near the set are supersampled
+    m_adaptive = estimate && ps.oversample > 1;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ComputePixel() - Computes the (possibly oversampled) fractal value of the pixel centered at the
+//                  specified coordinates
+//=========================================================================================================
+frac_value CPlotter::ComputePixel(double real, double imag)
+{
+    frac_value value;
+    escape     center = {0, 0, 0.0, 0.0};
 
     // Set all of the components of a fractal value to "unused"
     value.e[0] = value.e[1] = { -2, 0 };
 
-    // Determine the left-most real coordinate in the render
-    double min_real = ps.coord.center.real - ps.coord.span.real / 2;
+    // Determine how wide 1/4 of a pixel is
+    double quarter_pixel = m_quarter_pixel;
 
+    // If we're supersampling adaptively, find out how far the center of the pixel is from the set.  A
+    // pixel that's far from the set gets its center sample for every sample
+    if (m_adaptive)
+    {
+        center = m_iterate(real, imag, m_dwell);
+        if (center.iter > 0 && center.estimate > ps.pixel_size)
+        {
+            for (U32 i=0; i<ps.oversample; ++i) value.e[i] = center;
+            return value;
+        }
+    }
 
-NextColumn:
+    // Otherwise, find the (possibly oversampled) fractal value of this pixel
+    switch (ps.oversample)
+    {
+    case 0:
+        value.e[0] = m_iterate(real, imag, m_dwell);
+        break;
+
+    case 4:
+        value.e[0] = m_iterate(real - quarter_pixel, imag - quarter_pixel, m_dwell);
+        value.e[1] = m_iterate(real - quarter_pixel, imag + quarter_pixel, m_dwell);
+        value.e[2] = m_iterate(real + quarter_pixel, imag - quarter_pixel, m_dwell);
+        value.e[3] = m_iterate(real + quarter_pixel, imag + quarter_pixel, m_dwell);
+        break;
 
-    // Fetch a new pixel columns (0 thru panel-width - 1)
-    int col_rel2_panel = IssueColumn();
+    case 9:
 
-    // If there are no columns left to process, we're done
-    if (col_rel2_panel < 0 || aborting)
-    {
-        NotifyComplete();
-        goto WaitForCommand;
+        value.e[0] = m_iterate(real - quarter_pixel, imag - quarter_pixel, m_dwell);
+        value.e[1] = m_iterate(real                , imag - quarter_pixel, m_dwell);
+        value.e[2] = m_iterate(real + quarter_pixel, imag - quarter_pixel, m_dwell);
+
+        value.e[3] = m_iterate(real - quarter_pixel, imag                , m_dwell);
+        value.e[4] = m_adaptive ? center : m_iterate(real, imag, m_dwell);
+        value.e[5] = m_iterate(real + quarter_pixel, imag                , m_dwell);
+
+        value.e[6] = m_iterate(real - quarter_pixel, imag + quarter_pixel, m_dwell);
+        value.e[7] = m_iterate(real                , imag + quarter_pixel, m_dwell);
+        value.e[8] = m_iterate(real + quarter_pixel, imag + quarter_pixel, m_dwell);
+        break;
     }
 
-    // Convert this column number (local to this panel) to a pixel x-coordinate
-    U32 pixel_x = panel_left_x + col_rel2_panel;
+    return value;
+}
+//=========================================================================================================
+
 
+//=========================================================================================================
+// ComputeColumn() - Computes the fractal value of each pixel in a range of rows of a column of the panel
+//                   into "m_column".  If "mirror_rows" is true, the column is its own mirror image (rows
+//                   y and y' mirror each other), so only the unique half of the range is computed.
+//                   Returns false if we're aborting
+//=========================================================================================================
+bool CPlotter::ComputeColumn(U32 col, bool mirror_rows, U32 first_row, U32 row_count)
+{
     // Compute the real value that corresponds to this column
-    double real = min_real + (ps.pixel_size * pixel_x);
+    double real = m_min_real + (ps.pixel_size * (ps.panel_left + col));
+
+    // Loop through each row of pixels in the range
+    for (U32 y=first_row; y<first_row + row_count; ++y)
+    {
+        // If we've been told to abort, make it so
+        if (aborting) return false;
+
+        // If the mirror image of this pixel is a row we've already computed, mirror it
+        if (mirror_rows)
+        {
+            int mirror = m_mirror_row_sum - (int)(ps.panel_top + y) - (int)ps.panel_top;
+            if (mirror >= (int)first_row && mirror < (int)y)
+            {
+                m_column[y] = m_column[mirror];
+                MirrorValue(m_column[y], m_symmetry);
+                continue;
+            }
+        }
+
+        // Otherwise, compute it
+        m_column[y] = ComputePixel(real, imaginary[y]);
+    }
 
-    // Point to our list of imaginary values to use
-    double* p_i = imaginary;
+    // Tell the caller that the column is complete
+    return true;
+}
+//=========================================================================================================
 
-    // Point to the first element of this column
-    pixel* p_element= ps.bitmap + col_rel2_panel;
 
-    // Loop through each row of pixels
-    for (U32 pixel_y=0; pixel_y<ps.rows; ++pixel_y)
+//=========================================================================================================
+// StoreColumn() - Shades a range of rows of a column of fractal values into the panel, and stores the
+//                 fractal values (or the escape data) where they belong
+//=========================================================================================================
+void CPlotter::StoreColumn(U32 col, const vector<frac_value>& values, U32 first_row, U32 row_count)
+{
+    U32 last_row = first_row + row_count;
+
+    // This is how many samples there are per pixel
+    U32 spp = ps.oversample ? ps.oversample : 1;
+
+    // Shade the column
+    Shader.GetColors(values.data() + first_row, m_colors.data() + first_row, row_count);
+
+    // Store each pixel into the bitmap
+    pixel* p_pixel = ps.bitmap + (U64)first_row * ps.cols_this_panel + col;
+    for (U32 y=first_row; y<last_row; ++y, p_pixel += ps.cols_this_panel) *p_pixel = m_colors[y];
+
+    // If we're computing the viewport, store the fractal values for later use
+    if (ps.bitmap == viewport)
     {
-        // If we've been told to abort, make it so
-        if (aborting)
+        for (U32 y=first_row; y<last_row; ++y) fractal[y * ps.cols_this_panel + col] = values[y];
+    }
+
+    // If we're saving escape data, store the value of each sample
+    if (ps.samples)
+    {
+        for (U32 y=first_row; y<last_row; ++y)
         {
-            NotifyComplete();
-            goto WaitForCommand;
+            escape_sample* p_sample = ps.samples + ((U64)y * ps.cols_this_panel + col) * spp;
+            for (U32 i=0; i<spp; ++i)
+            {
+                p_sample[i].iter     = values[y].e[i].iter;
+                p_sample[i].distance = (float)values[y].e[i].distance;
+            }
         }
+    }
+
+    // We've completed this range of points
+    pixels_completed_cs.Lock();
+    pixels_completed += row_count;
+    pixels_completed_cs.Unlock();
+}
+//=========================================================================================================
+
 
-        // look up the imaginary portion of this coordinate
-        double imag = *p_i++;
+//=========================================================================================================
+// PlotColumn() - Plots a range of rows of a column of the panel.  When the panel can make use of the
+//                fractal's symmetry, only the unique half of it is computed, and the rest is mirrored.
+//                Columns are only split into ranges of rows when the panel has no symmetry
+//=========================================================================================================
+void CPlotter::PlotColumn(U32 col, U32 first_row, U32 row_count)
+{
+    U32 rows = ps.rows_this_panel;
 
-        // Find the (possibly oversampled) fractal value of this pixel
-        switch (ps.oversample)
+    // Without rotational symmetry, every column is plotted on its own.  Conjugate symmetry mirrors the
+    // top and bottom of the column into each other
+    if (m_symmetry != SYM_ROTATE)
+    {
+        if (ComputeColumn(col, m_symmetry == SYM_CONJUGATE, first_row, row_count))
         {
-        case 0:
-            value.e[0] = Iterator(real, imag);
-            break;
+            StoreColumn(col, m_column, first_row, row_count);
+        }
+        return;
+    }
 
-        case 4:
-            value.e[0] = Iterator(real - quarter_pixel, imag - quarter_pixel);
-            value.e[1] = Iterator(real - quarter_pixel, imag + quarter_pixel);
-            value.e[2] = Iterator(real + quarter_pixel, imag - quarter_pixel);
-            value.e[3] = Iterator(real + quarter_pixel, imag + quarter_pixel);
-            break;
+    // With rotational symmetry, this column's mirror image is another column, upside down
+    int mirror_col = m_mirror_col_sum - (int)(ps.panel_left + col) - (int)ps.panel_left;
+    bool has_mirror = (mirror_col >= 0 && mirror_col < (int)ps.cols_this_panel);
 
-        case 9:
+    // If the mirror column comes first, this column gets plotted along with it
+    if (has_mirror && mirror_col < (int)col) return;
 
-            value.e[0] = Iterator(real - quarter_pixel, imag - quarter_pixel);
-            value.e[1] = Iterator(real                , imag - quarter_pixel);
-            value.e[2] = Iterator(real + quarter_pixel, imag - quarter_pixel);
+    // Plot this column.  If it's its own mirror image, its top and bottom mirror each other
+    if (!ComputeColumn(col, mirror_col == (int)col, 0, rows)) return;
+    StoreColumn(col, m_column, 0, rows);
 
-            value.e[3] = Iterator(real - quarter_pixel, imag                );
-            value.e[4] = Iterator(real                , imag                );
-            value.e[5] = Iterator(real + quarter_pixel, imag                );
+    // If there's a separate mirror column, mirror what we can of it, and compute the rest
+    if (has_mirror && mirror_col != (int)col)
+    {
+        double real = m_min_real + (ps.pixel_size * (ps.panel_left + mirror_col));
 
-            value.e[6] = Iterator(real - quarter_pixel, imag + quarter_pixel);
-            value.e[7] = Iterator(real                , imag + quarter_pixel);
-            value.e[8] = Iterator(real + quarter_pixel, imag + quarter_pixel);
-            break;
+        m_mirror.resize(ps.rows_this_panel);
+        for (U32 y=0; y<ps.rows_this_panel; ++y)
+        {
+            if (aborting) return;
+            int mirror_row = m_mirror_row_sum - (int)(ps.panel_top + y) - (int)ps.panel_top;
+            if (mirror_row >= 0 && mirror_row < (int)ps.rows_this_panel)
+            {
+                m_mirror[y] = m_column[mirror_row];
+                MirrorValue(m_mirror[y], SYM_ROTATE);
+            }
+            else
+                m_mirror[y] = ComputePixel(real, imaginary[y]);
         }
+        StoreColumn(mirror_col, m_mirror, 0, rows);
+    }
+}
+//=========================================================================================================
 
-        // Fetch the pixel color that corresponds to this value
-        pixel px = Shader.GetColor(value);
 
-        // Compute the index of the element where this pixel gets stored
-        U32 index = pixel_y * ps.cols_this_panel + col_rel2_panel;
-        
-        // Store the pixel into the bitmap
-        ps.bitmap[index] = px;
+//=========================================================================================================
+// Main() - Computes particle paths through the complex plane
+//=========================================================================================================
+void CPlotter::Main(int P1, int P2, int P3)
+{   
+    char   command;
+
+WaitForCommand:
+
+    // Wait for a new command to arrive
+    ReadFile(m_hread_cmd, &command, 1, nullptr, nullptr);
+
+    // If we're just reshading, do so
+    if (command == MT_RESHADE)
+    {
+        Reshade();
+        NotifyComplete();
+        goto WaitForCommand;
+    }
+
+    // If we're recoloring a render from its escape data, do so
+    if (command == MT_RECOLOR)
+    {
+        Recolor();
+        NotifyComplete();
+        goto WaitForCommand;
+    }
+
+    // If we're building a histogram of escape counts, count our share of them
+    if (command == MT_HISTOGRAM || command == MT_PREPASS || command == MT_PREPASS_ESCAPE)
+    {
+        if (command == MT_HISTOGRAM) CountViewport();
+        if (command == MT_PREPASS) Prepass();
+        if (command == MT_PREPASS_ESCAPE) PrepassEscapeData();
+        NotifyComplete();
+        goto WaitForCommand;
+    }
+
+    // If we're merging the histograms of all the threads, merge our share of the bins
+    if (command == MT_MERGE_HISTOGRAM)
+    {
+        MergeHistogram();
+        NotifyComplete();
+        goto WaitForCommand;
+    }
+
+    // If we're color cycling (or getting ready to), do our share of the viewport
+    if (command == MT_CYCLE_RANGE || command == MT_CYCLE_INDEX || command == MT_CYCLE)
+    {
+        if (command == MT_CYCLE_RANGE) CycleRange();
+        if (command == MT_CYCLE_INDEX) CycleIndex();
+        if (command == MT_CYCLE) Cycle();
+        NotifyComplete();
+        goto WaitForCommand;
+    }
+
+    // If we're iterating points for the dwell planner, iterate our share of them
+    if (command == MT_ITERATE_POINTS)
+    {
+        IterateShare();
+        NotifyComplete();
+        goto WaitForCommand;
+    }
+
+    // Get ready to plot this panel
+    BeginPlot();
+
+NextColumn:
 
-        // If we're computing the viewport, store the fractal value for later use
-        if (ps.bitmap == viewport) fractal[index] = value;
+    // Fetch a new unit of work (a column, or a range of rows of one)
+    int unit = IssueWork();
+
+    // If there is no work left to do, note when we ran out, and we're done
+    if (unit < 0 || aborting)
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        m_finish_time = now.QuadPart;
+        NotifyComplete();
+        goto WaitForCommand;
     }
 
-    // We've completed an entire column of points
-    columns_completed_cs.Lock();
-    ++columns_completed;
-    columns_completed_cs.Unlock();
+    // Plot this column (and its mirror image, if it has one)
+    const work_unit& w = m_work[unit];
+    PlotColumn(w.col, w.first_row, w.row_count);
 
     // Go fetch another column to compute
     goto NextColumn;
@@ -424,27 +1681,228 @@ void ComputeImaginaryValues()
     // Determine the largest imaginary coordinate.  (The one at the very top of the image)
     double max_imaginary = ps.coord.center.imag + ps.coord.span.imag/2;
 
-    // Loop through each row of pixels
-    for (U32 pixel_y=0; pixel_y<ps.rows; ++pixel_y)
+    // We need one imaginary value for every row in this panel
+    imaginary.resize(ps.rows_this_panel);
+
+    // Loop through each row of pixels in the panel
+    for (U32 y=0; y<ps.rows_this_panel; ++y)
     {
+        // This is the row number within the entire image
+        U32 pixel_y = ps.panel_top + y;
+
         // Compute the imaginary portion of this coordinate
-        imaginary[pixel_y] = max_imaginary - (ps.coord.span.imag * pixel_y / ps.rows);
+        imaginary[y] = max_imaginary - (ps.coord.span.imag * pixel_y / ps.rows);
     }
             
 }
 //============================================================================================================
 
 
+//============================================================================================================
+// PanelCount() - Returns the number of panels the current render is split into
+//============================================================================================================
+U32 PanelCount()
+{
+    // How many panels does it take to span the width and height of the image?
+    U32 across = (ps.columns + ps.panel_width  - 1) / ps.panel_width;
+    U32 down   = (ps.rows    + ps.panel_height - 1) / ps.panel_height;
+
+    // Hand the caller the number of panels in the render
+    return across * down;
+}
+//============================================================================================================
+
+
+//============================================================================================================
+// SetPanelGeometry() - Fills in the position and size of panel number "ps.panel_number"
+//
+// In RM_COLUMNS mode, panels are full-height columns ordered from left to right.  In RM_BANDS mode, panels
+// are full-width bands ordered from the bottom of the image to the top, which is the order that rows are
+// stored in a BMP file.  In RM_TILES mode, panels are rectangular tiles ordered left to right within a
+// row of tiles, and rows of tiles are ordered from the bottom of the image to the top.  The grid of
+// panels always starts at the upper-left corner of the image so that tiles line up with the tiles of a
+// tiled image format.
+//
+// RM_COLUMNS and RM_BANDS are just RM_TILES with only one row or column of tiles.  When writing a PNG
+// file, rows of panels are ordered from the top of the image to the bottom instead
+//============================================================================================================
+void SetPanelGeometry()
+{
+    // How many panels does it take to span the width of the image?
+    U32 across = (ps.columns + ps.panel_width - 1) / ps.panel_width;
+
+    // How many panels does it take to span the height of the image?
+    U32 down = (ps.rows + ps.panel_height - 1) / ps.panel_height;
+
+    // Find the column and row (counted from the bottom) of this panel
+    U32 tile_x = ps.panel_number % across;
+    U32 tile_y = ps.panel_number / across;
+
+    // A PNG file is written from the top down, so in that case the rows of panels are rendered in
+    // that order instead
+    if (output_format == OF_PNG) tile_y = down - 1 - tile_y;
+
+    // The left edge of this panel
+    ps.panel_left = tile_x * ps.panel_width;
+
+    // This panel is a panel-width wide, but never extends past the right side of the image
+    ps.cols_this_panel = ps.columns - ps.panel_left;
+    if (ps.cols_this_panel > ps.panel_width) ps.cols_this_panel = ps.panel_width;
+
+    // The grid of panels is anchored at the top of the image, so the bottom row of panels may be short
+    ps.panel_top = (down - 1 - tile_y) * ps.panel_height;
+
+    // This panel is a panel-height tall, but never extends past the bottom of the image
+    ps.rows_this_panel = ps.rows - ps.panel_top;
+    if (ps.rows_this_panel > ps.panel_height) ps.rows_this_panel = ps.panel_height;
+}
+//============================================================================================================
+
+
+//============================================================================================================
+// PanelAt() - Returns the number of the panel that contains pixel (x, y) of the image.  This is the
+//             reverse of "SetPanelGeometry()"
+//============================================================================================================
+static U32 PanelAt(U32 x, U32 y)
+{
+    // How many panels does it take to span the width and height of the image?
+    U32 across = (ps.columns + ps.panel_width  - 1) / ps.panel_width;
+    U32 down   = (ps.rows    + ps.panel_height - 1) / ps.panel_height;
+
+    // Find which column of panels and which row of panels (from the top) the pixel is in
+    U32 tile_x = x / ps.panel_width;
+    U32 tile_y = y / ps.panel_height;
+    if (tile_x >= across) tile_x = across - 1;
+    if (tile_y >= down)   tile_y = down - 1;
+
+    // Rows of panels are numbered from the bottom of the image, except when writing a PNG file
+    if (output_format != OF_PNG) tile_y = down - 1 - tile_y;
+
+    // Hand the caller the panel number
+    return tile_y * across + tile_x;
+}
+//============================================================================================================
+
+
 //=========================================================================================================
-// Main() - Starts up when the worker thread gets spawned
+// OutputFilename() - Returns the name of the output image in the current output format
 //=========================================================================================================
-void CWorker::Main(int P1, int P2, int P3)
+static CString OutputFilename()
+{
+    const wchar_t* fn_table[] = {L"render.bmp", L"render.tif", L"render.png", L"render.dzi"};
+    return fn_table[output_format];
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// FreeRenderBuffers() - Releases the buffers and files used by a full render or recolor
+//=========================================================================================================
+static void FreeRenderBuffers()
+{
+    EscapeReader.Close();
+    FreeBuffer(escape_buffer);
+    FreeBuffer(panel);
+    escape_buffer = nullptr;
+    panel         = nullptr;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// GetPanelRegion() - Returns the region of the complex plane that the current panel covers
+//=========================================================================================================
+static T_COORD GetPanelRegion()
+{
+    T_COORD region;
+
+    // Find the upper-left corner of the image
+    double min_real = ps.coord.center.real - ps.coord.span.real / 2;
+    double max_imag = ps.coord.center.imag + ps.coord.span.imag / 2;
+
+    // Find the span of the panel, and its center
+    region.span.real   = ps.pixel_size * ps.cols_this_panel;
+    region.span.imag   = ps.coord.span.imag * ps.rows_this_panel / ps.rows;
+    region.center.real = min_real + ps.pixel_size * ps.panel_left + region.span.real / 2;
+    region.center.imag = max_imag - ps.coord.span.imag * ps.panel_top / ps.rows - region.span.imag / 2;
+
+    return region;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// StitchPanelFiles() - Stitches panel_0001.bmp, panel_0002.bmp... (side-by-side strips of an image, as
+//                      older versions of the program rendered them) into the output image in the current
+//                      output format.  The panel files are left where they are
+//=========================================================================================================
+void CWorker::StitchPanelFiles()
 {
-    CString fn;
     CStitcher stitcher;
+    CString   panel_fn;
+
+    // Gather up the panel files, for as long as they keep being numbered in sequence
+    U32 count = 0;
+    while (true)
+    {
+        panel_fn.Format(L"panel_%04u.bmp", count + 1);
+        if (GetFileAttributes(panel_fn) == INVALID_FILE_ATTRIBUTES) break;
+        stitcher.AddFile(panel_fn);
+        ++count;
+    }
+
+    // If there aren't any, there's nothing to do
+    if (count == 0)
+    {
+        Printf(0, L"There are no panel_XXXX.bmp files to stitch");
+        NotifyUI(CWM_PROGRESS, PROGRESS_FAILED);
+        return;
+    }
 
-    // We're not aborting
+    // Stitch them together
+    CString fn = OutputFilename();
+    NotifyUI(CWM_PROGRESS, PROGRESS_STITCHING);
+    if (!stitcher.Stitch(fn, output_format))
+    {
+        Printf(0, L"Unable to stitch the panel files into %s", (const wchar_t*)fn);
+        NotifyUI(CWM_PROGRESS, PROGRESS_FAILED);
+        return;
+    }
+
+    // And tell the user that all is well
+    Printf(0, L"Stitched %u panel files into %s", count, (const wchar_t*)fn);
+    NotifyUI(CWM_PROGRESS, PROGRESS_FINISHED);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Main() - Starts up when the worker thread gets spawned
+//=========================================================================================================
+void CWorker::Main(int P1, int P2, int P3)
+{
+    // We're not aborting, and nothing has gone wrong reading the escape data
     aborting = false;
+    CPlotter::ClearReadFailed();
+
+    // If we've been asked to stitch panel files together, that's all we do
+    if (P1 == MT_STITCH)
+    {
+        StitchPanelFiles();
+        TerminateThread();
+    }
+
+    // Are we plotting, or recoloring a previous render from its escape data?
+    bool recolor = (P1 == MT_RECOLOR);
+
+    // Are we drawing the viewport, or doing a full render?
+    bool full_render = (ps.bitmap != viewport);
+
+    // A full render (but not a recolor) can save the escape value of every sample
+    bool save_escape_data = (full_render && !recolor && export_escape_data);
+
+    // Keep track of whether the viewport's fractal values will include distance estimates
+    if (!full_render) viewport_has_estimates = CPlotter::EstimatesDistance();
 
     // How often will we check for progress updates?
     U32 update_delay = (ps.bitmap == viewport) ? 200 : 2000;
@@ -455,35 +1913,127 @@ void CWorker::Main(int P1, int P2, int P3)
     // Tell the UI that we're at 0%
     NotifyUI(CWM_PROGRESS, 0);
 
-    // This is the global variable that tracked completed columns
-    columns_completed = 0;
+    // If the dwell limit is automatic, plan one for the viewport.  The UI shows it when we're done
+    if (auto_dwell && !full_render && !recolor) dwell = PlanDwell(ps.coord);
+
+    // This is the global variable that tracks completed pixels
+    pixels_completed = 0;
+
+    // This is the total number of pixels in the render
+    U64 total_pixels = (U64)ps.rows * ps.columns;
+
+    // Find out how many panels this render is split into
+    U32 panel_count = PanelCount();
+
+    // This is how many pixels are in each half of the panel buffer
+    U64 half_panel_size = (U64)ps.panel_width * ps.panel_height;
 
-    // We haven't rendered any columns yet
-    U32 cols_remaining = ps.columns;
+    // A full render allocates its panel buffer now, and frees it when the render is done
+    if (full_render)
+    {
+        panel = (pixel*)AllocateBuffer(2 * half_panel_size * sizeof(pixel));
+        if (panel == nullptr)
+        {
+            Printf(0, L"Unable to allocate the panel buffer");
+            FreeRenderBuffers();
+            NotifyUI(CWM_PROGRESS, PROGRESS_ABORTED);
+            TerminateThread();
+        }
+    }
 
-    // Start out with panel number 0
-    ps.panel_number = 0;
+    // A full render alternates between the two halves of the panel buffer
+    pixel* panel_half[2] = {panel, panel + half_panel_size};
 
-    // Compute all the imaginary values our render is going to use
-    ComputeImaginaryValues();
+    // This is the name of the output image
+    CString fn = OutputFilename();
 
-    // While there are columns remaining to render...
-    while (cols_remaining)
+    // Start counting the bytes we write to disk, and the time we spend waiting for the disk
+    CAsyncFile::ResetStats();
+    CPlotter::ResetStats();
+
+    // A full render writes each panel straight into its place in the output image
+    if (full_render && !PanelWriter.Open(fn, output_format, ps.columns, ps.rows))
     {
-        // We'd like to render all remaining columns
-        ps.cols_this_panel = cols_remaining;
+        Printf(0, L"Unable to create %s", (const wchar_t*)fn);
+        FreeRenderBuffers();
+        NotifyUI(CWM_PROGRESS, PROGRESS_ABORTED);
+        TerminateThread();
+    }
+
+    // If we're saving escape data, each half of the panel buffer gets a matching half of the escape
+    // buffer, and the samples of each panel are written into the escape-data file
+    escape_sample* samples_half[2] = {nullptr, nullptr};
+    ps.samples = nullptr;
+    if (save_escape_data)
+    {
+        U32 spp       = ps.oversample ? ps.oversample : 1;
+        U64 half_size = half_panel_size * spp;
+
+        escape_buffer = (escape_sample*)AllocateBuffer(2 * half_size * sizeof(escape_sample));
+
+        if (escape_buffer == nullptr || !PanelWriter.OpenEscapeData(L"render.esc", ps.columns, ps.rows, spp))
+        {
+            PanelWriter.Close(true);
+            FreeRenderBuffers();
+            Printf(0, L"Unable to create render.esc");
+            NotifyUI(CWM_PROGRESS, PROGRESS_ABORTED);
+            TerminateThread();
+        }
+
+        samples_half[0] = escape_buffer;
+        samples_half[1] = escape_buffer + half_size;
+    }
+
+    // Find the dwell limit of each panel.  With automatic dwell, each panel of a full render gets a dwell
+    // of its own, which is never more than the dwell of the whole view
+    panel_dwell.assign(panel_count, dwell);
+    if (auto_dwell && full_render && !recolor)
+    {
+        for (ps.panel_number = 0; ps.panel_number < panel_count && !aborting; ++ps.panel_number)
+        {
+            SetPanelGeometry();
+            U32 planned = PlanDwell(GetPanelRegion());
+            if (planned < dwell) panel_dwell[ps.panel_number] = planned;
+        }
+    }
 
-        // We can only render one panel-width's of pixels at a time
-        if (ps.cols_this_panel > ps.panel_width) ps.cols_this_panel = ps.panel_width;
+    // Histogram-equalized shading needs the distribution of escape counts before anything can be shaded.
+    // A full render gets it from a low-resolution prepass, so that each panel can be shaded on its own
+    bool equalize = (Shader.GetScheme() == CS_HISTOGRAM);
+    if (equalize && full_render)
+    {
+        if (recolor)
+            CPlotter::BuildHistogram(MT_PREPASS_ESCAPE, EscapeReader.Header().dwell);
+        else
+            CPlotter::BuildHistogram(MT_PREPASS, dwell);
+    }
+
+    // Loop through each panel of the render...
+    for (ps.panel_number = 0; ps.panel_number < panel_count; ++ps.panel_number)
+    {
+        // Determine where this panel lies within the image
+        SetPanelGeometry();
+
+        // This is the dwell limit for this panel
+        ps.dwell = panel_dwell[ps.panel_number];
+
+        // Compute the imaginary values for the rows of this panel
+        ComputeImaginaryValues();
+
+        // A full render plots into whichever half of the panel isn't being written to disk
+        if (full_render) ps.bitmap = panel_half[ps.panel_number % 2];
+
+        // And the same goes for the escape data
+        ps.samples = samples_half[ps.panel_number % 2];
         
-        // Start rendering this panel
-        CPlotter::StartPanel(MT_PLOT);
+        // Start rendering (or recoloring) this panel
+        CPlotter::StartPanel(recolor ? MT_RECOLOR : MT_PLOT);
         
         // Until we hit 100% complete...
         while (CPlotter::ThreadsCompleted() != cpu_count)
         {
             // Compute the new percentage
-            U32 new_pct = (U32)(100 * columns_completed / ps.columns);
+            U32 new_pct = (U32)(100 * pixels_completed / total_pixels);
 
             // If the percent complete has changed, say so
             if (new_pct != pct_complete)
@@ -499,45 +2049,94 @@ void CWorker::Main(int P1, int P2, int P3)
         // Wait for all plotting threads to complete
         for (U32 i=0; i<cpu_count; ++i)  Plotter[i].Wait();
 
-        // If we're aborting this render, delete the panels and drop dead
+        // Keep track of how long threads sat idle waiting for the last of them to finish the panel
+        if (!recolor) CPlotter::TallyIdleTime();
+
+        // If we're aborting this render (or couldn't read the escape data for it), delete the partial
+        // image and drop dead
         if (aborting)
         {
-            stitcher.Cleanup();
-            NotifyUI(CWM_PROGRESS, PROGRESS_ABORTED);
+            PanelWriter.Close(true);
+            FreeRenderBuffers();
+            if (CPlotter::ReadFailed())
+            {
+                Printf(0, L"Unable to read render.esc.  It may be damaged");
+                NotifyUI(CWM_PROGRESS, PROGRESS_FAILED);
+            }
+            else
+                NotifyUI(CWM_PROGRESS, PROGRESS_ABORTED);
             TerminateThread();
         }
 
-        // If we're doing a full render to the panel...
-        if (ps.bitmap != viewport)
+        // If the writer couldn't write the last panel (because the disk is full, say), the output is
+        // lost, so there's no point in going on
+        if (full_render && !PanelWriter.Wait())
         {
-            // Construct a filename for this panel
-            fn.Format(L"panel_%04i.bmp", ps.panel_number + 1);
-
-            // And write this bitmap file
-            WriteBmp(fn, panel, ps.cols_this_panel, ps.rows, 0);
-
-            // Add this filename to the list of stitcher inputs
-            stitcher.AddFile(fn);
+            PanelWriter.Close(true);
+            FreeRenderBuffers();
+            Printf(0, L"Unable to write %s", (const wchar_t*)fn);
+            NotifyUI(CWM_PROGRESS, PROGRESS_FAILED);
+            TerminateThread();
         }
 
-        // Increment for the next panel number
-        ++ps.panel_number;
+        // If we're doing a full render, hand this panel to the writer thread.  It will be written
+        // into the output image while we plot the next panel into the other half of the panel buffer
+        if (full_render)
+        {
+            PanelWriter.Start(ps.bitmap, ps.samples, ps.panel_left, ps.panel_top, ps.cols_this_panel, ps.rows_this_panel);
+        }
+    }
 
-        // This is how many columns we have left to render
-        cols_remaining -= ps.cols_this_panel;
+    // The viewport was shaded as it was plotted, before its histogram existed.  Now that we can count
+    // its escape counts, reshade it
+    if (equalize && !full_render && !aborting)
+    {
+        CPlotter::BuildHistogram(MT_HISTOGRAM, dwell);
+        CPlotter::StartPanel(MT_RESHADE);
+        for (U32 i=0; i<cpu_count; ++i) Plotter[i].Wait();
     }
 
     // Tell the UI that we are 100% complete
     NotifyUI(CWM_PROGRESS, 100);
 
-    // If this was a full render, stitch together the rendered panels
-    if (ps.bitmap != viewport)
+    // If this was a full render, wait for the last panel to be written and close the image
+    if (full_render)
     {
-        NotifyUI(CWM_PROGRESS, PROGRESS_STITCHING);
-        stitcher.Stitch(L"render.bmp");
+        // If the last panel (or the end of the file) couldn't be written, the render has failed
+        if (!PanelWriter.Close())
+        {
+            FreeRenderBuffers();
+            Printf(0, L"Unable to write %s", (const wchar_t*)fn);
+            NotifyUI(CWM_PROGRESS, PROGRESS_FAILED);
+            TerminateThread();
+        }
+
+        // Report how fast the output files were written, and how long we were held up by the disk
+        U64    bytes_written;
+        double write_seconds, wait_seconds;
+        CAsyncFile::GetStats(&bytes_written, &write_seconds, &wait_seconds);
+        if (bytes_written)
+        {
+            double mb = bytes_written / 1048576.0;
+            Printf(0, L"Wrote %.1lf MB in %.1lf seconds (%.1lf MB/s), waited %.1lf seconds for the disk",
+                   mb, write_seconds, write_seconds ? mb / write_seconds : 0.0, wait_seconds);
+        }
+
+        // Report how long plotting threads sat idle at the ends of panels
+        if (!recolor)
+        {
+            double idle_seconds, idle_fraction;
+            CPlotter::GetStats(&idle_seconds, &idle_fraction);
+            Printf(0, L"Threads sat idle at the ends of panels for %.2lf seconds (%.1lf%% of plotting time)",
+                   idle_seconds, 100 * idle_fraction);
+        }
+
         NotifyUI(CWM_PROGRESS, PROGRESS_FINISHED);
     }
 
+    // We're done with the panel buffer and the escape data
+    FreeRenderBuffers();
+
     // We're done with the computations
     TerminateThread();
 }
@@ -1,13 +1,38 @@
 #pragma once
 #include "CThread.h"
 #include "typedefs.h"
+#include "EscapeFile.h"
 
 //=========================================================================================================
 // These are the availbale Multi-threaded commands available
 //=========================================================================================================
 enum
 {
-    MT_PLOT, MT_RESHADE
+    MT_PLOT, MT_RESHADE, MT_RECOLOR,
+
+    // These build the histogram that histogram-equalized shading needs
+    MT_HISTOGRAM, MT_PREPASS, MT_PREPASS_ESCAPE, MT_MERGE_HISTOGRAM,
+
+    // These prepare the viewport for color cycling, and shade a frame of the animation
+    MT_CYCLE_RANGE, MT_CYCLE_INDEX, MT_CYCLE,
+
+    // This iterates a list of points for the dwell planner and the cost probe
+    MT_ITERATE_POINTS,
+
+    // This is only ever handed to the worker thread.  It stitches panel files into the output image
+    MT_STITCH
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// The symmetries that a fractal can have.  A conjugate-symmetric fractal has the same escape value at
+// c and at its complex conjugate (it's symmetric about the real axis).  A rotationally-symmetric one
+// has the same escape value at z and -z (it's symmetric under a 180 degree rotation about the origin)
+//=========================================================================================================
+enum
+{
+    SYM_NONE, SYM_CONJUGATE, SYM_ROTATE
 };
 //=========================================================================================================
 
@@ -23,6 +48,17 @@ struct T_COORD
 //=========================================================================================================
 
 
+//=========================================================================================================
+// The iterator for the current fractal, the same iterator with distance estimation, and the same again
+// with distance estimates for points inside the set too.  Each returns the escape value of a point,
+// giving up after "max_iter" iterations
+//=========================================================================================================
+extern escape (*Iterator)(double real, double imag, U32 max_iter);
+extern escape (*IteratorDE)(double real, double imag, U32 max_iter);
+extern escape (*IteratorDEI)(double real, double imag, U32 max_iter);
+//=========================================================================================================
+
+
 //=========================================================================================================
 // CWorker - This is the class/thread that performs all background tasks
 //=========================================================================================================
@@ -32,6 +68,11 @@ public:
 
     // This routine is called when this thread spawns
     void Main(int P1, int P2, int P3);
+
+protected:
+
+    // Stitches panel_0001.bmp, panel_0002.bmp... into the output image
+    void StitchPanelFiles();
 };
 //=========================================================================================================
 
@@ -54,6 +95,44 @@ public:
     // Returns a count of the number of threads that have completed their task
     static U32  ThreadsCompleted();
 
+    // Returns true if plotting with the current settings estimates the distance to the set
+    static bool EstimatesDistance();
+
+    // Returns true if a tile of the escape-data file couldn't be read.  When that happens, the recolor
+    // is stopped by setting "aborting"
+    static bool ReadFailed() {return m_read_failed;}
+
+    // Forgets about any tile that couldn't be read
+    static void ClearReadFailed() {m_read_failed = false;}
+
+    // Builds the histogram of escape counts and hands it to the shader.  "command" says where the
+    // escape counts come from: the viewport (MT_HISTOGRAM), a low-resolution plot of the render
+    // (MT_PREPASS), or a sampling of the tiles in the escape-data file (MT_PREPASS_ESCAPE).
+    // "max_iter" is the largest escape count
+    static void BuildHistogram(char command, U32 max_iter);
+
+    // Prepares the viewport for color cycling: the escape value of every sample is computed once and
+    // stored as an index into the shader's color-cycling lookup table
+    static void PrepareCycle();
+
+    // Shades a frame of color cycling into the viewport, with the lookup table rotated by "shift"
+    static void CycleFrame(U32 shift);
+
+    // Iterates every point in "points" (giving up after "max_iter" iterations) and stores each one's
+    // escape value in "results".  The points are shared out among the plotter threads
+    static void IteratePoints(const vector<complex>& points, U32 max_iter, vector<escape>& results);
+
+    // Adds the time that threads spent idle at the end of the panel that was just plotted to the
+    // statistics.  Call this once every thread has finished the panel
+    static void TallyIdleTime();
+
+    // Resets the idle-time statistics
+    static void ResetStats();
+
+    // Fetches the time that threads have spent idle at the ends of panels, in seconds and as a fraction
+    // of the time they spent plotting
+    static void GetStats(double* idle_seconds, double* idle_fraction);
+
     // Initialize this computation thread
     void Init();
 
@@ -73,13 +152,113 @@ public:
 
 protected:
 
-    static int      IssueColumn();
+    // A unit of plotting work: a column of the panel, or a range of rows of one
+    struct work_unit
+    {
+        U32 col;
+        U32 first_row;
+        U32 row_count;
+    };
+
+    static void     PlanWork();
+    static int      IssueWork();
+    static int      IssueTile();
+    static void     FindSymmetry();
+    static void     MirrorValue(frac_value& value, int symmetry);
+    void            BeginPlot();
+    frac_value      ComputePixel(double real, double imag);
+    bool            ComputeColumn(U32 col, bool mirror_rows, U32 first_row, U32 row_count);
+    void            StoreColumn(U32 col, const vector<frac_value>& values, U32 first_row, U32 row_count);
+    void            PlotColumn(U32 col, U32 first_row, U32 row_count);
     void            Reshade();
+    void            Recolor();
+    void            CountViewport();
+    void            Prepass();
+    void            PrepassEscapeData();
+    void            MergeHistogram();
+    void            GetViewportRows(U32* first_row, U32* row_count);
+    void            CycleRange();
+    void            CycleIndex();
+    void            Cycle();
+    void            IterateShare();
     void            NotifyComplete();
-    volatile static U32  m_next_column;
+    volatile static U32  m_next_unit;
+    volatile static U32  m_next_tile;
+    volatile static bool m_read_failed;
+
+    // The units of work that make up the current panel, most expensive first
+    static vector<work_unit> m_work;
+
+    // When plotting of the current panel began, and the idle and total thread time of every panel
+    // plotted since the statistics were reset (all in performance-counter ticks)
+    static U64      m_panel_start;
+    static U64      m_idle_ticks;
+    static U64      m_thread_ticks;
+
+    // The symmetry of the current fractal, and the symmetry that the current panel can make use of.
+    // Image rows y and y' mirror each other when y + y' = m_mirror_row_sum, and the same goes for
+    // columns and m_mirror_col_sum
+    static int      m_fractal_symmetry;
+    static int      m_symmetry;
+    static int      m_mirror_row_sum;
+    static int      m_mirror_col_sum;
+
+    // The size of the histogram, the number of escape counts in each bin, and the histogram that every
+    // thread's histogram is merged into
+    static U32         m_histogram_bins;
+    static U32         m_histogram_width;
+    static vector<U64> m_merged_histogram;
+
+    // The color-cycling index of every sample in the viewport, and the current rotation of the table
+    static vector<U16> m_cycle_index;
+    static U32         m_cycle_shift;
+
+    // The points being iterated for the dwell planner or the cost probe, the iteration limit, and their
+    // escape values
+    static const vector<complex>* m_points;
+    static U32                    m_points_limit;
+    static vector<escape>*        m_points_result;
 
     volatile bool m_is_task_complete;
 
+    // When this thread ran out of work on the current panel (in performance-counter ticks)
+    U64     m_finish_time;
+
+    // When recoloring, each tile of escape data is decoded into here
+    vector<escape_sample> m_tile;
+
+    // Fractal values waiting to be shaded together, and the colors they shade to
+    vector<frac_value> m_values;
+    vector<pixel>      m_colors;
+
+    // The fractal values of the column being plotted, and of its mirror image
+    vector<frac_value> m_column;
+    vector<frac_value> m_mirror;
+
+    // How this thread is plotting the current panel: the iterator, whether it supersamples adaptively,
+    // the size of a quarter pixel, and the real coordinate of the left edge of the image
+    escape  (*m_iterate)(double real, double imag, U32 max_iter);
+    U32     m_dwell;
+    bool    m_adaptive;
+    double  m_quarter_pixel;
+    double  m_min_real;
+
+    // The escape values of a batch of samples, and the range of escape values this thread has seen
+    vector<double> m_escape_values;
+    double  m_cycle_lo, m_cycle_hi;
+
+    // The histogram of the escape counts that this thread has seen
+    vector<U64> m_histogram;
+
+    // Counts a sample in this thread's histogram.  Samples that never escaped aren't counted
+    void Count(int iter)
+    {
+        if (iter <= 0) return;
+        U32 bin = (U32)iter / m_histogram_width;
+        if (bin >= m_histogram_bins) bin = m_histogram_bins - 1;
+        ++m_histogram[bin];
+    }
+
     HANDLE  m_hread_cmd, m_hwrite_cmd;
     HANDLE  m_hread_rsp, m_hwrite_rsp;
 
@@ -0,0 +1,379 @@
+//=========================================================================================================
+// PngWriter.cpp - Writes rendered images as PNG files, compressing strips of rows in parallel
+//
+// A PNG file is a signature followed by a series of chunks.  Each chunk is a big-endian length, a
+// 4-character type, the data, and a CRC-32 of the type and data.  The image data is a single zlib stream
+// that may be split across any number of IDAT chunks.  We write:
+//
+//     Signature
+//     IHDR chunk
+//     IDAT chunk holding the 2-byte zlib header
+//     One IDAT chunk per compressed strip of rows
+//     IDAT chunk holding the end of the deflate stream and the zlib Adler-32 checksum
+//     IEND chunk
+//=========================================================================================================
+#include "stdafx.h"
+#include "PngWriter.h"
+#include "Deflate.h"
+#include "Globals.h"
+
+// We aim to compress this many bytes of image data in each strip
+static const U32 STRIP_BYTES = 1024 * 1024;
+
+
+//=========================================================================================================
+// CCrcTable - The table for computing the CRC-32 used by PNG chunks
+//=========================================================================================================
+static struct CCrcTable
+{
+    U32 entry[256];
+
+    CCrcTable()
+    {
+        for (U32 n=0; n<256; ++n)
+        {
+            U32 c = n;
+            for (int k=0; k<8; ++k) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            entry[n] = c;
+        }
+    }
+} crc_table;
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Crc32() - Updates a running CRC-32 with a block of data.  Start with "crc" = 0
+//=========================================================================================================
+static U32 Crc32(U32 crc, const U8* data, size_t length)
+{
+    crc = ~crc;
+    while (length--) crc = crc_table.entry[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// PutU32() - Stores a 32-bit value in big-endian byte order
+//=========================================================================================================
+static void PutU32(U8* p, U32 value)
+{
+    p[0] = (U8)(value >> 24);
+    p[1] = (U8)(value >> 16);
+    p[2] = (U8)(value >>  8);
+    p[3] = (U8)(value      );
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WriteChunk() - Writes a complete chunk to a PNG file
+//=========================================================================================================
+static bool WriteChunk(FILE* ofile, const char* type, const U8* data, U32 length)
+{
+    U8 hdr[8], trailer[4];
+
+    // The chunk header is the length of the data and the chunk type
+    PutU32(hdr, length);
+    memcpy(hdr + 4, type, 4);
+
+    // The chunk trailer is the CRC of the chunk type and data
+    PutU32(trailer, Crc32(Crc32(0, hdr + 4, 4), data, length));
+
+    // Write the chunk
+    fwrite(hdr, 1, sizeof hdr, ofile);
+    fwrite(data, 1, length, ofile);
+    return fwrite(trailer, 1, sizeof trailer, ofile) == sizeof trailer;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// FilterRow() - Converts a row of pixels to PNG format.  Every row uses the "Sub" filter: each byte is
+//               stored as the difference between it and the same byte of the pixel to its left.  Unlike
+//               the other filters, this never needs the row above, which might belong to a different
+//               strip or panel
+//=========================================================================================================
+static void FilterRow(U8* out, pixel* p_pixel, U32 cols)
+{
+    U8 r = 0, g = 0, b = 0;
+
+    // The filter-type byte
+    *out++ = 1;
+
+    for (U32 x=0; x<cols; ++x)
+    {
+        *out++ = p_pixel->r - r;
+        *out++ = p_pixel->g - g;
+        *out++ = p_pixel->b - b;
+        r = p_pixel->r;
+        g = p_pixel->g;
+        b = p_pixel->b;
+        ++p_pixel;
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WriteHeader() - Writes the PNG signature and IHDR chunk for an 8-bit RGB image
+//=========================================================================================================
+static bool WriteHeader(FILE* ofile, U32 cols, U32 rows)
+{
+    static const U8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    U8 ihdr[13];
+
+    // Build the IHDR: 8-bit RGB, deflate compression, adaptive filtering, not interlaced
+    PutU32(ihdr + 0, cols);
+    PutU32(ihdr + 4, rows);
+    ihdr[8]  = 8;
+    ihdr[9]  = 2;
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+
+    // Write the signature and the IHDR
+    fwrite(signature, 1, sizeof signature, ofile);
+    return WriteChunk(ofile, "IHDR", ihdr, sizeof ihdr);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WritePng() - Writes a complete (and typically small) PNG file in a single thread.  "stride" is the
+//              distance in pixels from one row of the image to the next, or 0 if the rows are packed
+//=========================================================================================================
+bool WritePng(CString fn, pixel* image, U32 cols, U32 rows, U32 stride)
+{
+    FILE*      ofile;
+    vector<U8> raw, packed;
+    U32        row_length = cols * 3 + 1;
+
+    // If the caller didn't specify a stride, the rows are packed
+    if (stride == 0) stride = cols;
+
+    // Filter every row of the image
+    raw.resize((size_t)row_length * rows);
+    for (U32 y=0; y<rows; ++y)
+    {
+        FilterRow(raw.data() + (size_t)y * row_length, image + (U64)y * stride, cols);
+    }
+
+    // Compress the whole thing into a single zlib stream
+    ZlibCompress(raw.data(), raw.size(), packed);
+
+    // Create and open the output file
+    if (_wfopen_s(&ofile, fn, L"wb") != 0) return false;
+
+    // Write the header, the image data, and the end of the file
+    WriteHeader(ofile, cols, rows);
+    WriteChunk(ofile, "IDAT", packed.data(), (U32)packed.size());
+    bool ok = WriteChunk(ofile, "IEND", nullptr, 0);
+
+    // Close the file, and tell the caller whether all is well
+    return (fclose(ofile) == 0) && ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Create() - Creates the output file and writes everything that comes before the image data
+//=========================================================================================================
+bool CPngWriter::Create(CString fn, U32 cols, U32 rows)
+{
+    static const U8 zlib_header[2] = {0x78, 0x01};
+
+    // Make sure any file we previously had open is closed
+    Close();
+
+    // Create and open the output file
+    if (_wfopen_s(&m_ofile, fn, L"wb") != 0)
+    {
+        m_ofile = nullptr;
+        return false;
+    }
+
+    // Keep track of the file name and image dimensions
+    m_fn   = fn;
+    m_cols = cols;
+    m_rows = rows;
+
+    // No rows have been written yet, and this is the checksum of no data
+    m_rows_written = 0;
+    m_adler        = 1;
+
+    // A row in the file is a filter-type byte followed by 3 bytes per pixel.  Decide how many rows
+    // we can put in each strip
+    m_strip_rows = STRIP_BYTES / (cols * 3 + 1);
+    if (m_strip_rows == 0) m_strip_rows = 1;
+
+    // Each encoder thread gets a buffer for building one uncompressed strip
+    m_raw.resize(MAX_THREADS);
+
+    // Write the signature, the IHDR, and the start of the zlib stream
+    WriteHeader(m_ofile, cols, rows);
+    if (!WriteChunk(m_ofile, "IDAT", zlib_header, sizeof zlib_header))
+    {
+        Close(true);
+        return false;
+    }
+
+    // Tell the caller that all is well
+    return true;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// EncodeItem() - Called by encoder thread "thread" to compress strip number "item" of the current panel
+//=========================================================================================================
+void CPngWriter::EncodeItem(U32 item, U32 thread)
+{
+    U32 row_length = m_cols * 3 + 1;
+
+    // Find the rows of the panel that make up this strip
+    U32 first_row = item * m_strip_rows;
+    U32 rows      = m_panel_rows - first_row;
+    if (rows > m_strip_rows) rows = m_strip_rows;
+
+    // Get a reference to this thread's strip buffer, and make sure it's big enough
+    vector<U8>& raw = m_raw[thread];
+    raw.resize((size_t)row_length * rows);
+
+    // Loop through each row of the strip...
+    for (U32 y=0; y<rows; ++y)
+    {
+        // Point to the first pixel of this row of the panel
+        pixel* p_pixel = m_bitmap + (U64)(first_row + y) * m_cols;
+
+        // Filter this row into the strip buffer
+        FilterRow(raw.data() + (size_t)y * row_length, p_pixel, m_cols);
+    }
+
+    // Compress the strip, ending it on a byte boundary so it can be appended to the previous strip
+    strip& s = m_strip[item];
+    s.packed.clear();
+    Deflate(raw.data(), raw.size(), false, s.packed);
+
+    // Compute the checksum of the uncompressed strip and the CRC of the IDAT chunk that will hold it
+    s.length = (U32)raw.size();
+    s.adler  = Adler32(1, raw.data(), raw.size());
+    s.crc    = Crc32(Crc32(0, (const U8*)"IDAT", 4), s.packed.data(), s.packed.size());
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WritePanel() - Compresses each strip of a panel and appends it to the file
+//=========================================================================================================
+bool CPngWriter::WritePanel(pixel* bitmap, U32 left, U32 top, U32 cols, U32 rows)
+{
+    bool ok = true;
+
+    // If the output file isn't open, we can't write anything
+    if (m_ofile == nullptr) return false;
+
+    // A PNG file is written from top to bottom, one full row at a time
+    if (left != 0 || cols != m_cols || top != m_rows_written) return false;
+
+    // Record the panel we're about to compress
+    m_bitmap     = bitmap;
+    m_panel_rows = rows;
+
+    // Determine how many strips make up this panel
+    U32 strip_count = (rows + m_strip_rows - 1) / m_strip_rows;
+
+    // Make room for the compressed strips
+    m_strip.resize(strip_count);
+
+    // Start the encoder threads compressing strips
+    CEncoder::StartJob(this, strip_count);
+
+    // As each strip finishes compressing (in order), write it to the file
+    for (U32 item=0; item<strip_count; ++item)
+    {
+        U8 hdr[8], trailer[4];
+
+        // Wait for this strip to be compressed
+        CEncoder::WaitForItem(item);
+
+        strip& s = m_strip[item];
+
+        // Fold the checksum of this strip into the checksum of the whole stream
+        m_adler = Adler32Combine(m_adler, s.adler, s.length);
+
+        // Write the strip as an IDAT chunk.  Its CRC has already been computed
+        PutU32(hdr, (U32)s.packed.size());
+        memcpy(hdr + 4, "IDAT", 4);
+        PutU32(trailer, s.crc);
+        if (ok)
+        {
+            fwrite(hdr, 1, sizeof hdr, m_ofile);
+            fwrite(s.packed.data(), 1, s.packed.size(), m_ofile);
+            ok = fwrite(trailer, 1, sizeof trailer, m_ofile) == sizeof trailer;
+        }
+
+        // We're done with the compressed data
+        s.packed.clear();
+        s.packed.shrink_to_fit();
+    }
+
+    // Keep track of how much of the image we've written
+    m_rows_written += rows;
+
+    // Tell the caller whether all is well
+    return ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WriteTrailer() - Ends the compressed stream and writes the IEND chunk
+//=========================================================================================================
+bool CPngWriter::WriteTrailer()
+{
+    U8 data[6];
+
+    // If we didn't receive every row of the image, the file is useless
+    if (m_rows_written != m_rows) return false;
+
+    // The end of the deflate stream, followed by the big-endian checksum of the uncompressed data
+    memcpy(data, DEFLATE_END, 2);
+    PutU32(data + 2, m_adler);
+
+    // Write the last IDAT chunk and the IEND chunk
+    WriteChunk(m_ofile, "IDAT", data, sizeof data);
+    return WriteChunk(m_ofile, "IEND", nullptr, 0);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Close() - Finishes the file and closes it, or optionally deletes it
+//=========================================================================================================
+bool CPngWriter::Close(bool erase)
+{
+    bool ok = true;
+
+    // If the file is open, finish it and close it
+    if (m_ofile)
+    {
+        // If we're going to keep this file, it needs a trailer
+        if (!erase && !WriteTrailer()) {erase = true; ok = false;}
+
+        // The last of the data is only written when the file is closed
+        if (fclose(m_ofile) != 0 && !erase) {erase = true; ok = false;}
+        m_ofile = nullptr;
+
+        // If we've been asked to (or couldn't finish the file), delete it
+        if (erase) DeleteFile(m_fn);
+    }
+
+    // Free our buffers
+    m_raw.clear();
+    m_strip.clear();
+
+    // Tell the caller whether the file was completely written
+    return ok;
+}
+//=========================================================================================================
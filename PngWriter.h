@@ -0,0 +1,79 @@
+//=========================================================================================================
+// PngWriter.h - Describes the class that writes rendered images as PNG files
+//=========================================================================================================
+#pragma once
+#include "Image.h"
+#include "Encoder.h"
+
+//=========================================================================================================
+// CPngWriter - Streams full-width panels of pixels into a PNG file.  Panels must arrive in order from the
+//              top of the image to the bottom.  Each panel is split into strips of rows that are
+//              compressed in parallel by the encoder threads.  Every strip ends on a deflate sync-flush
+//              boundary, so the compressed strips are simply written one after another, each in its own
+//              IDAT chunk, to form a single zlib stream.
+//=========================================================================================================
+class CPngWriter : public CImageWriter, public CEncodeJob
+{
+public:
+
+    // Default constructor
+    CPngWriter() {m_ofile = nullptr;}
+
+    // Destructor closes the file if it's still open
+    ~CPngWriter() {Close();}
+
+    // Creates the output file and writes the PNG header
+    bool    Create(CString fn, U32 cols, U32 rows);
+
+    // Compresses the rows of a panel and appends them to the file
+    bool    WritePanel(pixel* bitmap, U32 left, U32 top, U32 cols, U32 rows);
+
+    // Finishes the compressed stream and closes the file, optionally deleting it.  Returns false if
+    // the file couldn't be completely written
+    bool    Close(bool erase = false);
+
+    // Called by the encoder threads to compress one strip of the current panel
+    void    EncodeItem(U32 item, U32 thread);
+
+protected:
+
+    // Finishes the compressed stream and writes the end of the file
+    bool    WriteTrailer();
+
+    // The name of the output file
+    CString m_fn;
+
+    // The output file itself
+    FILE*   m_ofile;
+
+    // Dimensions of the complete image
+    U32     m_cols;
+    U32     m_rows;
+
+    // The number of rows that have been written so far
+    U32     m_rows_written;
+
+    // The number of rows in each strip that gets compressed as a unit
+    U32     m_strip_rows;
+
+    // The running Adler-32 checksum of all of the uncompressed data written so far
+    U32     m_adler;
+
+    // The panel currently being compressed
+    pixel*  m_bitmap;
+    U32     m_panel_rows;
+
+    // One buffer per encoder thread for building an uncompressed strip
+    vector<vector<U8>> m_raw;
+
+    // For each strip of the current panel: the compressed data, plus the checksums that go with it
+    struct strip
+    {
+        vector<U8> packed;
+        U32        length;
+        U32        adler;
+        U32        crc;
+    };
+    vector<strip> m_strip;
+};
+//=========================================================================================================
@@ -16,7 +16,12 @@ static CSpecFile sf;
 bool ReadSettings()
 {
     CScript   s;
+    CString   mode;
     poi       place;
+    int       budget;
+    CString   name;
+    gradient_stop         stop;
+    vector<gradient_stop> stops;
    
     // None of these places are built-ins
     place.builtin = false;
@@ -43,6 +48,66 @@ bool ReadSettings()
         }
     }
 
+    // If the "GRADIENTS" spec exists, each line of it is a user-defined gradient: a name, followed by
+    // the position (0 to 1) and the red, green, and blue values (0 to 255) of each stop
+    if (sf.Exists(L"gradients"))
+    {
+        // Fetch the script
+        sf.Get(L"gradients", &s);
+
+        // Loop through each line of the spec...
+        while (s.GetNextLine())
+        {
+            name = s.GetNextWord();
+            stops.clear();
+            for (CString word = s.GetNextWord(); word != L""; word = s.GetNextWord())
+            {
+                stop.x = _wtof(word);
+                stop.r = s.GetNextFloat();
+                stop.g = s.GetNextFloat();
+                stop.b = s.GetNextFloat();
+                stops.push_back(stop);
+            }
+
+            // Bake the gradient, and complain if it doesn't make sense
+            if (!Shader.AddGradient(name, stops)) Popup(L"Gradient \"%s\" in %s is invalid", (const wchar_t*)name, (const wchar_t*)settings_fn);
+        }
+    }
+
+    // Find out how full renders should be split into panels
+    if (sf.Exists(L"render_mode"))
+    {
+        sf.Get(L"render_mode", &mode);
+        mode = MakeLower(mode);
+        if      (mode == L"bands") render_mode = RM_BANDS;
+        else if (mode == L"tiles") render_mode = RM_TILES;
+        else                       render_mode = RM_COLUMNS;
+    }
+
+    // Find out what file format full renders should be written in
+    if (sf.Exists(L"output_format"))
+    {
+        sf.Get(L"output_format", &mode);
+        mode = MakeLower(mode);
+        if      (mode == L"tiff") output_format = OF_TIFF;
+        else if (mode == L"png")  output_format = OF_PNG;
+        else if (mode == L"dzi")  output_format = OF_DZI;
+        else                      output_format = OF_BMP;
+    }
+
+    // Find out whether full renders should save their escape data for recoloring later
+    if (sf.Exists(L"escape_data")) sf.Get(L"escape_data", &export_escape_data);
+
+    // Find out whether the dwell limit should be chosen automatically for each view
+    if (sf.Exists(L"auto_dwell")) sf.Get(L"auto_dwell", &auto_dwell);
+
+    // Find out how many megabytes a full render may use for its panel buffers
+    if (sf.Exists(L"memory_budget"))
+    {
+        sf.Get(L"memory_budget", &budget);
+        if (budget > 0) memory_budget = budget;
+    }
+
     // Tell the caller that all is well
     return true;
 }
@@ -65,6 +130,23 @@ bool SaveSettings()
     // Output a numner that tells us the format of this file
     fprintf(ofile, "FORMAT = 1\n\n");
 
+    // Output the render mode ("columns", "bands", or "tiles")
+    const char* mode_name[] = {"columns", "bands", "tiles"};
+    fprintf(ofile, "RENDER_MODE = %s\n\n", mode_name[render_mode]);
+
+    // Output the file format of a full render ("bmp", "tiff", "png", or "dzi")
+    const char* format_name[] = {"bmp", "tiff", "png", "dzi"};
+    fprintf(ofile, "OUTPUT_FORMAT = %s\n\n", format_name[output_format]);
+
+    // Output whether full renders save their escape data ("on" or "off")
+    fprintf(ofile, "ESCAPE_DATA = %s\n\n", export_escape_data ? "on" : "off");
+
+    // Output whether the dwell limit is chosen automatically ("on" or "off")
+    fprintf(ofile, "AUTO_DWELL = %s\n\n", auto_dwell ? "on" : "off");
+
+    // Output the memory budget for full renders, in megabytes
+    fprintf(ofile, "MEMORY_BUDGET = %u\n\n", memory_budget);
+
     // Output the "Points of interest" header
     fprintf(ofile, "POI =\n{\n");
 
@@ -103,8 +185,24 @@ bool SaveSettings()
         );
     }
 
-    // Tell the caller that we saved his file
     fprintf(ofile, "}\n\n");
+
+    // Output the user-defined gradients, one per line
+    const vector<gradient>& gradients = Shader.GetGradients();
+    if (!gradients.empty())
+    {
+        fprintf(ofile, "GRADIENTS =\n{\n");
+        for (auto& g : gradients)
+        {
+            CStringA name = toCStringA(g.name);
+            fprintf(ofile, "    \"%s\"", name.GetBuffer(0));
+            for (auto& stop : g.stops) fprintf(ofile, ", %g, %g, %g, %g", stop.x, stop.r, stop.g, stop.b);
+            fprintf(ofile, "\n");
+        }
+        fprintf(ofile, "}\n\n");
+    }
+
+    // Tell the caller that we saved his file
     fclose(ofile);
     return true;
 }
@@ -7,6 +7,8 @@
 #include "Globals.h"
 #include "WinUtilsImp.h"
 #include <math.h>
+#include <float.h>
+#include <emmintrin.h>
 
 //=========================================================================================================
 // Handy constants
@@ -188,51 +190,100 @@ static pixel hsv2rgb(double h, double s, double v)
 //=========================================================================================================
 CShader::CShader()
 {
+    m_scheme    = CS_DEFAULT;
+    m_fixed_hue = 0;
+    m_cdf_scale = 1.0;
+    m_pipeline  = &CShader::ShadePipeline<CS_DEFAULT, 0, false, 0>;
+
     Init_OBW_Gradient();
+    m_gradient = &m_obw_gradient;
+    BuildPalette0Lut();
+    BuildPalette2Lut();
+    BuildDemLut();
 }
 //=========================================================================================================
 
 
 //=========================================================================================================
-// Init_OBW_Gradient() - Initializes the gradient for the Orange/Blue/White color scheme
+// ChannelValue() - Rounds a splined color channel value to the nearest 0-255 byte
 //=========================================================================================================
-void CShader::Init_OBW_Gradient()
+static U8 ChannelValue(double v)
 {
-    pixel p;
+    // The spline passes through the stops, but clamp it anyway so the conversion is always defined
+    v = floor(v + 0.5);
+    if (!(v > 0)) return 0;
+    if (v > 255)  return 255;
+    return (U8)v;
+}
+//=========================================================================================================
 
-    // Find out how many entries are in the orange/blue/white gradient
-    unsigned gradient_length = sizeofa(m_obw_gradient);
 
-    // These are the default gradient settings from "UltraFractal".  I like their color scheme :-)
-    double x[6] = {0.0000, 0.1600, 0.4200, 0.6425, 0.8575, 1.0000};
-    double y_red[6] = {  0,  32, 237, 255, 0,   0};
-    double y_grn[6] = {  7, 107, 255, 170, 2,   7};
-    double y_blu[6] = {100, 203, 255,   0, 0, 100};
-
-    // Create the cubic splines that define the gradient
-    spline_red.  CreateInterpolant(x, y_red, 6);
-    spline_green.CreateInterpolant(x, y_grn, 6);
-    spline_blue. CreateInterpolant(x, y_blu, 6);
-
-    // Build the gradient
-    for (unsigned i = 0; i<gradient_length; ++i)
-    {
-        // Determine how far along our gradient we are (between 0 and 1)
-        double ratio = i / (double)(gradient_length - 1);
-
-        // Compute the colors for this position in the gradient
-        p.r = (U8)(spline_red  .Interpolate(ratio));
-        p.g = (U8)(spline_green.Interpolate(ratio));
-        p.b = (U8)(spline_blue .Interpolate(ratio));
-        p.a = 255;
-
-        // Store the pixel color for this position in the gradient
-        m_obw_gradient[i] = p;
+//=========================================================================================================
+// BakeGradient() - Bakes a gradient into a lookup table with "length" entries.  Each color channel is
+//                  a monotonic cubic spline through the stops
+//=========================================================================================================
+static void BakeGradient(gradient& g, U32 length)
+{
+    CubicMonoSpline spline[3];
+    vector<double>  x, y[3], channel[3];
+
+    // Split the stops up into one set of points per color channel
+    for (auto& stop : g.stops)
+    {
+        x.push_back(stop.x);
+        y[0].push_back(stop.r);
+        y[1].push_back(stop.g);
+        y[2].push_back(stop.b);
+    }
+
+    // Create the cubic splines that define the gradient, and evaluate each one across its full length
+    for (int i=0; i<3; ++i)
+    {
+        spline[i].CreateInterpolant(x.data(), y[i].data(), (unsigned)x.size());
+        channel[i].resize(length);
+        spline[i].Bake(0, 1, channel[i].data(), length);
+    }
+
+    // And build the gradient from them
+    g.lut.resize(length);
+    for (U32 i=0; i<length; ++i)
+    {
+        g.lut[i].r = ChannelValue(channel[0][i]);
+        g.lut[i].g = ChannelValue(channel[1][i]);
+        g.lut[i].b = ChannelValue(channel[2][i]);
+        g.lut[i].a = 255;
     }
 
+    // The table repeats every GRADIENT_PERIOD units of the smoothed escape value
+    g.scale = length / GRADIENT_PERIOD;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Init_OBW_Gradient() - Initializes the gradient for the Orange/Blue/White color scheme
+//=========================================================================================================
+void CShader::Init_OBW_Gradient()
+{
+    // These are the default gradient settings from "UltraFractal".  I like their color scheme :-)
+    const gradient_stop stops[] =
+    {
+        {0.0000,   0,   7, 100},
+        {0.1600,  32, 107, 203},
+        {0.4200, 237, 255, 255},
+        {0.6425, 255, 170,   0},
+        {0.8575,   0,   2,   0},
+        {1.0000,   0,   7, 100}
+    };
+
+    // Build the gradient.  It has always had 2048 entries
+    m_obw_gradient.name = L"Blue / Orange / White Gradient";
+    m_obw_gradient.stops.assign(stops, stops + sizeofa(stops));
+    BakeGradient(m_obw_gradient, 2048);
+
 #if 0
     pixel* image = new pixel[2048 * 30];
-    for (int y=0; y<30; ++y) memcpy(&image[y * 2048], m_obw_gradient, 2048 * sizeof pixel);
+    for (int y=0; y<30; ++y) memcpy(&image[y * 2048], m_obw_gradient.lut.data(), 2048 * sizeof pixel);
     WriteBmp(L"gradient.bmp", image, 2048, 30);
     delete[] image;
 #endif
@@ -240,6 +291,46 @@ void CShader::Init_OBW_Gradient()
 //=========================================================================================================
 
 
+//=========================================================================================================
+// AddGradient() - Adds a user-defined gradient color scheme.  There must be at least two stops, running
+//                 in ascending order from 0 to 1, with red, green, and blue values from 0 to 255
+//=========================================================================================================
+bool CShader::AddGradient(CString name, const vector<gradient_stop>& stops)
+{
+    gradient g;
+
+    // Make sure the stops describe a gradient
+    if (stops.size() < 2 || stops.front().x != 0 || stops.back().x != 1) return false;
+    for (size_t i=1; i<stops.size(); ++i) if (stops[i].x <= stops[i-1].x) return false;
+
+    // Make sure every stop is a real position and a real color.  The comparisons are written so that
+    // a NaN fails them too
+    for (auto& stop : stops)
+    {
+        if (!_finite(stop.x)) return false;
+        if (!(stop.r >= 0 && stop.r <= 255)) return false;
+        if (!(stop.g >= 0 && stop.g <= 255)) return false;
+        if (!(stop.b >= 0 && stop.b <= 255)) return false;
+    }
+
+    // Bake the gradient into its lookup table
+    g.name  = name;
+    g.stops = stops;
+    BakeGradient(g, GRADIENT_LUT_SIZE);
+
+    // Add it to our list.  If a user-defined gradient is in use, the list may have moved
+    m_user_gradient.push_back(g);
+    if (m_scheme >= CS_USER_GRADIENT && m_scheme - CS_USER_GRADIENT < (int)m_user_gradient.size())
+    {
+        m_gradient = &m_user_gradient[m_scheme - CS_USER_GRADIENT];
+    }
+
+    // Tell the caller that all is well
+    return true;
+}
+//=========================================================================================================
+
+
 //=========================================================================================================
 // ColorSpan() - Generates a spectrum of colors by varying the luminosity of a specified hue and
 //               saturation.
@@ -313,6 +404,50 @@ pixel CShader::palette2(double d)
 //=========================================================================================================
 
 
+//=========================================================================================================
+// BuildPalette0Lut() - Fills in the lookup table for "palette0()".  This depends on the color scheme and
+//                      the fixed hue, so it's rebuilt whenever either of them changes
+//=========================================================================================================
+void CShader::BuildPalette0Lut()
+{
+    for (U32 i=0; i<PALETTE_LUT_SIZE; ++i) m_palette0_lut[i] = palette0(i);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// BuildPalette2Lut() - Fills in the lookup table for "palette2()"
+//=========================================================================================================
+void CShader::BuildPalette2Lut()
+{
+    for (U32 i=0; i<PALETTE_LUT_SIZE; ++i) m_palette2_lut[i] = palette2(i);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// BuildDemLut() - Fills in the lookup tables for distance-estimation shading.  The boundary of the set is
+//                 black, and the shade brightens quickly to white within a pixel of it, so filaments
+//                 that are far thinner than a pixel still show up as fine lines.  The interior of the
+//                 set brightens the same way, but to a deep blue
+//=========================================================================================================
+void CShader::BuildDemLut()
+{
+    for (U32 i=0; i<DEM_LUT_SIZE; ++i)
+    {
+        double t = pow((double)i / (DEM_LUT_SIZE - 1), 0.25);
+
+        U8 shade = (U8)(t * 255);
+        pixel px = { shade, shade, shade, 255 };
+        m_dem_lut[i] = px;
+
+        pixel interior = { (U8)(t * 160), (U8)(t * 64), (U8)(t * 32), 255 };
+        m_dem_interior_lut[i] = interior;
+    }
+}
+//=========================================================================================================
+
+
 
 //=========================================================================================================
 // SetScheme() - Declares which color scheme to use when "GetPixelColor()" is called
@@ -324,9 +459,24 @@ void CShader::SetScheme(int scheme_id)
 
     switch (scheme_id)
     {
+        case CS_DEFAULT:
+        case CS_FIXED_HUE:
+            BuildPalette0Lut();
+            break;
+
         case CS_OBW_LINEAR:
             Init_OBW_LINEAR();
             break;
+
+        case CS_OBW_GRADIENT:
+            m_gradient = &m_obw_gradient;
+            break;
+    }
+
+    // A user-defined gradient just needs to be pointed to
+    if (scheme_id >= CS_USER_GRADIENT && scheme_id - CS_USER_GRADIENT < (int)m_user_gradient.size())
+    {
+        m_gradient = &m_user_gradient[scheme_id - CS_USER_GRADIENT];
     }
 }
 //=========================================================================================================
@@ -339,6 +489,9 @@ void CShader::SetFixedHue(double hue)
     // Save the hue for future use
     m_fixed_hue = hue;
 
+    // If we're using it, rebuild the palette lookup table with the new hue
+    if (m_scheme == CS_FIXED_HUE) BuildPalette0Lut();
+
     // And update the on-screen indicator
     fixed_hue_indicator.SetHue(hue);
 }
@@ -400,160 +553,645 @@ void CShader::InitSchemeNames(CComboBox* pCB)
     pCB->AddString(L" Blue / Orange / White Linear");
     pCB->AddString(L" Monochrome");
     pCB->AddString(L" Blue / Orange / White Gradient");
+    pCB->AddString(L" Histogram Equalized");
+    pCB->AddString(L" Distance Estimation");
     pCB->SetCurSel(0);
 }
 //=========================================================================================================
 
 
 //=========================================================================================================
-// GetRawColor() - Returns a pixel based upon the color scheme and escape value passed in
+// AddGradientNames() - Adds the names of the user-defined gradients to the color scheme ComboBox.  They
+//                      follow the built-in schemes, in the order they were added
+//=========================================================================================================
+void CShader::AddGradientNames(CComboBox* pCB)
+{
+    for (auto& g : m_user_gradient) pCB->AddString(L" " + g.name);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// LogPair() - Computes the natural log of two positive, normal doubles at once.  Each value is split
+//             into 2^e * m with m between sqrt(1/2) and sqrt(2), and log(m) = 2 * atanh(f), where
+//             f = (m - 1) / (m + 1), is summed as an odd series through f^13.  Since |f| < 0.172, the
+//             absolute error is below 1e-12
+//=========================================================================================================
+static inline __m128d LogPair(__m128d x)
+{
+    const __m128d one   = _mm_set1_pd(1.0);
+    const __m128d half  = _mm_set1_pd(0.5);
+    const __m128d sqrt2 = _mm_set1_pd(1.4142135623730951);
+    const __m128d ln2   = _mm_set1_pd(0.69314718055994531);
+    const __m128d two52 = _mm_set1_pd(4503599627370496.0);
+    const __m128i mantissa_mask = _mm_set1_epi64x(0x000FFFFFFFFFFFFFLL);
+    const __m128i exponent_of_1 = _mm_set1_epi64x(0x3FF0000000000000LL);
+
+    __m128i bits = _mm_castpd_si128(x);
+
+    // Pull out the exponent.  Placing it in the low bits of 2^52 and subtracting 2^52 converts it to a
+    // double
+    __m128d e = _mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(bits, 52), _mm_castpd_si128(two52)));
+    e = _mm_sub_pd(_mm_sub_pd(e, two52), _mm_set1_pd(1023.0));
+
+    // Pull out the mantissa, as a number between 1 and 2
+    __m128d m = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(bits, mantissa_mask), exponent_of_1));
+
+    // If the mantissa is above sqrt(2), halve it and bump the exponent
+    __m128d big = _mm_cmpge_pd(m, sqrt2);
+    m = _mm_sub_pd(m, _mm_and_pd(big, _mm_mul_pd(m, half)));
+    e = _mm_add_pd(e, _mm_and_pd(big, one));
+
+    // Sum the series for log(m)
+    __m128d f  = _mm_div_pd(_mm_sub_pd(m, one), _mm_add_pd(m, one));
+    __m128d f2 = _mm_mul_pd(f, f);
+    __m128d p  = _mm_set1_pd(2.0 / 13);
+    p = _mm_add_pd(_mm_mul_pd(p, f2), _mm_set1_pd(2.0 / 11));
+    p = _mm_add_pd(_mm_mul_pd(p, f2), _mm_set1_pd(2.0 / 9));
+    p = _mm_add_pd(_mm_mul_pd(p, f2), _mm_set1_pd(2.0 / 7));
+    p = _mm_add_pd(_mm_mul_pd(p, f2), _mm_set1_pd(2.0 / 5));
+    p = _mm_add_pd(_mm_mul_pd(p, f2), _mm_set1_pd(2.0 / 3));
+    p = _mm_add_pd(_mm_mul_pd(p, f2), _mm_set1_pd(2.0));
+
+    // log(x) = log(m) + e * log(2)
+    return _mm_add_pd(_mm_mul_pd(p, f), _mm_mul_pd(e, ln2));
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// LogBatch() - Replaces each value in an array with its natural log.  Values that aren't positive
+//              normal numbers (zeros, negatives, denormals, infinities and NaNs) are left to the C library
+//=========================================================================================================
+static void LogBatch(double* x, U32 count)
+{
+    const __m128d lo = _mm_set1_pd(DBL_MIN);
+    const __m128d hi = _mm_set1_pd(DBL_MAX);
+    double        result[2];
+
+    for (U32 i=0; i<count; i += 2)
+    {
+        // Load the next two values (or the last value twice)
+        U32 n = (count - i > 1) ? 2 : 1;
+        __m128d v = (n == 2) ? _mm_loadu_pd(x + i) : _mm_set1_pd(x[i]);
+
+        // Find out which of them the approximation can handle
+        int ok = _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(v, lo), _mm_cmple_pd(v, hi)));
+
+        // If it can handle both, we're done
+        if (n == 2 && ok == 3)
+        {
+            _mm_storeu_pd(x + i, LogPair(v));
+            continue;
+        }
+
+        // Otherwise, sort them out one at a time
+        _mm_storeu_pd(result, LogPair(v));
+        for (U32 j=0; j<n; ++j) x[i + j] = (ok & (1 << j)) ? result[j] : log(x[i + j]);
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ComputeEscapeValues() - Computes the smoothed escape value that color scheme SCHEME shades from, for
+//                         every sample of a batch of fractal values.  The logs are computed a whole batch
+//                         at a time by "LogBatch()".  "spp" is the number of samples per pixel
+//=========================================================================================================
+template <int SCHEME>
+static void ComputeEscapeValues(const frac_value* v, U32 count, U32 spp, double* d)
+{
+    U32 k, n = count * spp;
+
+    // Distance estimation shades from the estimated distance to the set, measured in pixels
+    if (SCHEME == CS_DEM)
+    {
+        double pixels_per_unit = 1 / ps.pixel_size;
+        for (k=0; k<n; ++k) d[k] = v[k / spp].e[k % spp].estimate * pixels_per_unit;
+        return;
+    }
+
+    // The Orange/Blue/White gradient smooths a little differently than the other schemes
+    const bool obw_gradient = (SCHEME == CS_OBW_GRADIENT);
+
+    // Fetch the distance of every sample.  Interior points don't have a meaningful distance, so we
+    // give them a harmless one.  They'll be shaded black anyway
+    for (k=0; k<n; ++k)
+    {
+        const escape& e = v[k / spp].e[k % spp];
+        if (e.iter == 0)
+            d[k] = 4;
+        else
+            d[k] = obw_gradient ? e.distance * ONE_OVER_LOG2 : e.distance;
+    }
+
+    // Compute log(log(distance) * 0.5), or log(log(distance * ONE_OVER_LOG2)) for the gradient
+    LogBatch(d, n);
+    if (!obw_gradient) for (k=0; k<n; ++k) d[k] *= 0.5;
+    LogBatch(d, n);
+
+    // Turn that into the smoothed escape value.  Histogram equalization uses the normalized iteration
+    // count, which lies between "iter" and "iter + 1"
+    for (k=0; k<n; ++k)
+    {
+        double smoothed = d[k] * ONE_OVER_LOG2;
+        int    iter     = v[k / spp].e[k % spp].iter;
+        if (obw_gradient)
+            d[k] = sqrt(iter + 1 - smoothed);
+        else if (SCHEME == CS_HISTOGRAM)
+            d[k] = iter + 1 - smoothed;
+        else
+            d[k] = iter + 10.0 - smoothed;
+    }
+
+    // The default and monochrome schemes shade from the log of the escape value
+    if (SCHEME == CS_DEFAULT || SCHEME == CS_MONOCHROME)
+    {
+        for (k=0; k<n; ++k) d[k] += 50;
+        LogBatch(d, n);
+        for (k=0; k<n; ++k) d[k] *= 100;
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ShadeSample() - Returns a pixel based upon color scheme SCHEME and the escape value of a sample, with
+//                 the color channels in the INVERT mask (1 = red, 2 = green, 4 = blue) inverted, and
+//                 converted to greyscale if GREY is true
 //=========================================================================================================
-pixel CShader::GetRawColor(escape& e)
+template <int SCHEME, int INVERT, bool GREY>
+pixel CShader::ShadeSample(const escape& e, double d)
 {
     pixel result;
 
-    // Apply the appropriate color scheme
-    switch(m_scheme)
+    // Interior points are black, unless we're shading them by their distance to the boundary.
+    // Otherwise, apply the color scheme
+    if (e.iter == 0)                    result = (SCHEME == CS_DEM) ? Shade5Interior(d) : black;
+    else if (SCHEME == CS_DEFAULT)      result = Shade0(d);
+    else if (SCHEME == CS_OBW_LINEAR)   result = Shade1(d);
+    else if (SCHEME == CS_MONOCHROME)   result = Shade2(d);
+    else if (SCHEME == CS_HISTOGRAM)    result = Shade4(d);
+    else if (SCHEME == CS_DEM)          result = Shade5(d);
+    else                                result = Shade3(d);
+
+    // Perform Color Inversions
+    if (INVERT & 1) result.r = 255 - result.r;
+    if (INVERT & 2) result.g = 255 - result.g;
+    if (INVERT & 4) result.b = 255 - result.b;
+
+    // Convert to greyscale if that option is selected
+    if (GREY)
     {
-        
-        case CS_DEFAULT:
-        case CS_FIXED_HUE:
-            result = GetRawColor0(e);
-            break;
+        U8 shade = (U8)(result.r * .299 + result.g * .587 + result.b * .114);
+        result.r = result.g = result.b = shade;
+    }
+
+
+    return result;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// ShadePipeline() - Shades an array of fractal values with one particular combination of settings.
+//                   SPP is the number of samples per pixel, or 0 to take it from "ps.oversample"
+//=========================================================================================================
+template <int SCHEME, int INVERT, bool GREY, U32 SPP>
+void CShader::ShadePipeline(const frac_value* v, pixel* out, U32 count)
+{
+    double d[SHADE_BATCH * sizeofa(v->e)];
+
+    // This is how many samples there are per pixel
+    const U32 spp = SPP ? SPP : ps.oversample;
+
+    // Shade the values a batch at a time
+    while (count)
+    {
+        U32 n = (count < SHADE_BATCH) ? count : SHADE_BATCH;
+
+        // Compute the escape value of every sample in this batch
+        ComputeEscapeValues<SCHEME>(v, n, spp, d);
 
+        for (U32 p=0; p<n; ++p)
+        {
+            const escape* e  = v[p].e;
+            const double* pd = d + p * spp;
+
+            // If we aren't oversampled, this is the ordinary color
+            if (SPP == 1)
+            {
+                out[p] = ShadeSample<SCHEME, INVERT, GREY>(e[0], pd[0]);
+                continue;
+            }
+
+            // Initialize accumulators for the red, green, and blue channels
+            U32 r=0, g=0, b=0;
+            pixel result;
+
+            for (U32 i = 0; i < spp; ++i)
+            {
+                // Get the color for this sub-sample
+                result = ShadeSample<SCHEME, INVERT, GREY>(e[i], pd[i]);
+
+                // Accumulate the sum of each color channel
+                r += result.r;
+                g += result.g;
+                b += result.b;
+            }
+
+            // Find the average color-channel values of all of the subpixels
+            result.r = r / spp;
+            result.g = g / spp;
+            result.b = b / spp;
+
+            // And that's the final color of our pixel
+            out[p] = result;
+        }
+
+        // Move on to the next batch
+        v     += n;
+        out   += n;
+        count -= n;
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// SelectSpp(), SelectGrey(), SelectInvert() - Between them, these pick the shading pipeline that is
+//                                             specialized for the current settings
+//=========================================================================================================
+template <int SCHEME, int INVERT, bool GREY>
+CShader::pipeline CShader::SelectSpp(U32 oversample)
+{
+    switch (oversample)
+    {
+        case 0:  return &CShader::ShadePipeline<SCHEME, INVERT, GREY, 1>;
+        case 4:  return &CShader::ShadePipeline<SCHEME, INVERT, GREY, 4>;
+        case 9:  return &CShader::ShadePipeline<SCHEME, INVERT, GREY, 9>;
+        default: return &CShader::ShadePipeline<SCHEME, INVERT, GREY, 0>;
+    }
+}
+
+template <int SCHEME, int INVERT>
+CShader::pipeline CShader::SelectGrey(bool grey, U32 oversample)
+{
+    return grey ? SelectSpp<SCHEME, INVERT, true >(oversample)
+                : SelectSpp<SCHEME, INVERT, false>(oversample);
+}
+
+template <int SCHEME>
+CShader::pipeline CShader::SelectInvert(int invert, bool grey, U32 oversample)
+{
+    switch (invert)
+    {
+        case 0:  return SelectGrey<SCHEME, 0>(grey, oversample);
+        case 1:  return SelectGrey<SCHEME, 1>(grey, oversample);
+        case 2:  return SelectGrey<SCHEME, 2>(grey, oversample);
+        case 3:  return SelectGrey<SCHEME, 3>(grey, oversample);
+        case 4:  return SelectGrey<SCHEME, 4>(grey, oversample);
+        case 5:  return SelectGrey<SCHEME, 5>(grey, oversample);
+        case 6:  return SelectGrey<SCHEME, 6>(grey, oversample);
+        default: return SelectGrey<SCHEME, 7>(grey, oversample);
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// SelectPipeline() - Chooses the shading pipeline for the current color scheme, color inversions,
+//                    greyscale setting, and oversampling.  Call this before shading with new settings
+//=========================================================================================================
+void CShader::SelectPipeline()
+{
+    // Build a mask of the color channels that get inverted
+    int invert = (invert_r ? 1 : 0) | (invert_g ? 2 : 0) | (invert_b ? 4 : 0);
+
+    // User-defined gradients shade exactly like the Orange/Blue/White gradient
+    int scheme = (m_scheme >= CS_USER_GRADIENT) ? CS_OBW_GRADIENT : m_scheme;
+
+    switch (scheme)
+    {
         case CS_OBW_LINEAR:
-            result = GetRawColor1(e);
+            m_pipeline = SelectInvert<CS_OBW_LINEAR>(invert, greyscale != 0, ps.oversample);
             break;
 
         case CS_MONOCHROME:
-            result = GetRawColor2(e);
+            m_pipeline = SelectInvert<CS_MONOCHROME>(invert, greyscale != 0, ps.oversample);
             break;
 
         case CS_OBW_GRADIENT:
-            result = GetRawColor3(e);
+            m_pipeline = SelectInvert<CS_OBW_GRADIENT>(invert, greyscale != 0, ps.oversample);
+            break;
+
+        case CS_HISTOGRAM:
+            m_pipeline = SelectInvert<CS_HISTOGRAM>(invert, greyscale != 0, ps.oversample);
+            break;
+
+        case CS_DEM:
+            m_pipeline = SelectInvert<CS_DEM>(invert, greyscale != 0, ps.oversample);
+            break;
+
+        default:
+            m_pipeline = SelectInvert<CS_DEFAULT>(invert, greyscale != 0, ps.oversample);
             break;
     }
+}
+//=========================================================================================================
 
-    // Perform Color Inversions
-    if (invert_r) result.r = 255 - result.r;
-    if (invert_g) result.g = 255 - result.g;
-    if (invert_b) result.b = 255 - result.b;
 
-    // Convert to greyscale if that option is selected
-    if (greyscale)
+//=========================================================================================================
+// GetColors() - Fetches the RGB pixels that correspond to an array of fractal values, using the
+//               pipeline chosen by the most recent call to "SelectPipeline()"
+//=========================================================================================================
+void CShader::GetColors(const frac_value* v, pixel* out, U32 count)
+{
+    (this->*m_pipeline)(v, out, count);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Shade0() - Translates a smoothed escape value to a pixel shade with the default palette
+//=========================================================================================================
+pixel CShader::Shade0(double d)
+{
+    double p = floor(d);
+
+    // Look up the two palette entries on either side of d, unless d is off the end of the table
+    if (p >= 0 && p < PALETTE_LUT_SIZE - 1)
     {
-        U8 shade = (U8)(result.r * .299 + result.g * .587 + result.b * .114);
-        result.r = result.g = result.b = shade;
+        U32 i = (U32)p;
+        return interpolate(m_palette0_lut[i], m_palette0_lut[i + 1], d - p);
     }
 
+    return interpolate(palette0(p), palette0(p+1), d - p);
+}
+//=========================================================================================================
 
-    return result;
+
+//=========================================================================================================
+// Shade1() - Translates a smoothed escape value to a pixel shade with the linear palette
+//=========================================================================================================
+pixel CShader::Shade1(double d)
+{
+    double zero_to_one = fabs(sin(d * .001));
+    return m_palette[(U32)(zero_to_one * m_palette_size)];
 }
 //=========================================================================================================
 
 
+//=========================================================================================================
+// Shade2() - Translates a smoothed escape value to a monochrome pixel shade
+//=========================================================================================================
+pixel CShader::Shade2(double d)
+{
+    double p = floor(d);
 
+    // Look up the two palette entries on either side of d, unless d is off the end of the table
+    if (p >= 0 && p < PALETTE_LUT_SIZE - 1)
+    {
+        U32 i = (U32)p;
+        return interpolate(m_palette2_lut[i], m_palette2_lut[i + 1], d - p);
+    }
+
+    return interpolate(palette2(p), palette2(p + 1), d - p);
+}
 //=========================================================================================================
-// GetColor - Returns the RGB pixel that corresponds to the specified value and current color_scheme
+
+
 //=========================================================================================================
-pixel CShader::GetColor(frac_value& v)
+// Shade3() - Translates a smoothed escape value to a pixel shade with the current gradient
+//=========================================================================================================
+pixel CShader::Shade3(double d)
 {
-    pixel result;
+    const gradient* g = m_gradient;
+    int colorI = (int) (d * g->scale) % (U32)g->lut.size();
+    return g->lut[colorI];
+}
+//=========================================================================================================
+
 
-    // If we aren't oversampled, return the ordinary color
-    if (ps.oversample == 0) return GetRawColor(v.e[0]);
+//=========================================================================================================
+// SetHistogram() - Turns a histogram of escape counts into the cumulative distribution that the
+//                  histogram-equalized scheme shades with
+//=========================================================================================================
+void CShader::SetHistogram(const vector<U64>& histogram, U32 width)
+{
+    U64 total = 0, running = 0;
 
-    // Initialize accumulators for the red, green, and blue channels
-    U32 r=0, g=0, b=0;
+    // Count the samples that escaped.  Samples that never escaped aren't in the histogram
+    for (size_t n=0; n<histogram.size(); ++n) total += histogram[n];
 
-    for (U32 i = 0; i < ps.oversample; ++i)
+    // Entry "n" of the distribution is the fraction of samples that escaped in fewer than n bins' worth
+    // of iterations
+    m_cdf.resize(histogram.size() + 1);
+    m_cdf[0] = 0;
+    for (size_t n=0; n<histogram.size(); ++n)
     {
-        // Get the raw color for this sub-sample
-        result = GetRawColor(v.e[i]);
+        running += histogram[n];
+        m_cdf[n + 1] = total ? (double)running / total : 0;
+    }
+
+    // Escape values are scaled by this to find their place in the distribution
+    m_cdf_scale = 1.0 / width;
+}
+//=========================================================================================================
 
-        // Accumulate the sum of each color channel
-        r += result.r;
-        g += result.g;
-        b += result.b;
+
+//=========================================================================================================
+// Shade4() - Translates a normalized iteration count to a pixel shade by histogram equalization: the
+//            count's position in the distribution of all escape counts picks the color from the
+//            Orange/Blue/White gradient, so that the colors are spread evenly across the image no
+//            matter how tightly the escape counts are clustered
+//=========================================================================================================
+pixel CShader::Shade4(double d)
+{
+    const vector<double>& cdf = m_cdf;
+    const vector<pixel>&  lut = m_obw_gradient.lut;
+    double t;
+
+    // If we haven't been given a histogram, there's nothing to go on
+    if (cdf.size() < 2) return black;
+
+    // Find where d falls in the distribution, interpolating between bins
+    d *= m_cdf_scale;
+    U32    last = (U32)cdf.size() - 1;
+    double p    = floor(d);
+    if (!(p >= 0))
+        t = cdf[0];
+    else if (p >= last)
+        t = cdf[last];
+    else
+    {
+        U32 i = (U32)p;
+        t = cdf[i] + (cdf[i + 1] - cdf[i]) * (d - p);
     }
 
-    // Find the average color-channel values of all of the subpixels
-    result.r = r / ps.oversample;
-    result.g = g / ps.oversample;
-    result.b = b / ps.oversample;
+    // And look up the color at that point in the gradient
+    return lut[(U32)(t * (lut.size() - 1))];
+}
+//=========================================================================================================
 
-    // And that's the final color of our pixel
-    return result;
+
+//=========================================================================================================
+// Shade5() - Translates an estimated distance to the set (in pixels) to a pixel shade
+//=========================================================================================================
+pixel CShader::Shade5(double d)
+{
+    if (!(d > 0)) return m_dem_lut[0];
+    if (d >= 1) return m_dem_lut[DEM_LUT_SIZE - 1];
+    return m_dem_lut[(U32)(d * (DEM_LUT_SIZE - 1))];
 }
 //=========================================================================================================
 
 
 //=========================================================================================================
-// GetRawColor0() - Translates an escape-time to a pixel-shade
+// Shade5Interior() - Translates an estimated distance to the boundary (in pixels) from a point inside
+//                    the set to a pixel shade.  Interior points without an estimate are black
 //=========================================================================================================
-pixel CShader::GetRawColor0(escape& e)
+pixel CShader::Shade5Interior(double d)
 {
-    if (e.iter == 0) return black;
+    if (!(d > 0)) return black;
+    if (d >= 1) return m_dem_interior_lut[DEM_LUT_SIZE - 1];
+    return m_dem_interior_lut[(U32)(d * (DEM_LUT_SIZE - 1))];
+}
+//=========================================================================================================
 
-    double smoothed = log(log(e.distance) * 0.5) * ONE_OVER_LOG2;
-    double d = e.iter + 10.0 - smoothed;
 
-    d += 50;
-    d = log(d);
-    d *= 100;
-    double p = floor(d);
-    return interpolate(palette0(p), palette0(p+1), d - p);
+//=========================================================================================================
+// GetEscapeValues() - Computes the smoothed escape value of every sample of an array of fractal values,
+//                     with the current color scheme
+//=========================================================================================================
+void CShader::GetEscapeValues(const frac_value* v, U32 count, double* d)
+{
+    // This is how many samples there are per pixel
+    U32 spp = ps.oversample ? ps.oversample : 1;
+
+    // User-defined gradients compute their escape values exactly like the Orange/Blue/White gradient
+    int scheme = (m_scheme >= CS_USER_GRADIENT) ? CS_OBW_GRADIENT : m_scheme;
+
+    switch (scheme)
+    {
+        case CS_OBW_LINEAR:   ComputeEscapeValues<CS_OBW_LINEAR  >(v, count, spp, d); break;
+        case CS_MONOCHROME:   ComputeEscapeValues<CS_MONOCHROME  >(v, count, spp, d); break;
+        case CS_OBW_GRADIENT: ComputeEscapeValues<CS_OBW_GRADIENT>(v, count, spp, d); break;
+        case CS_HISTOGRAM:    ComputeEscapeValues<CS_HISTOGRAM   >(v, count, spp, d); break;
+        case CS_DEM:          ComputeEscapeValues<CS_DEM         >(v, count, spp, d); break;
+        default:              ComputeEscapeValues<CS_DEFAULT     >(v, count, spp, d); break;
+    }
 }
 //=========================================================================================================
 
 
 //=========================================================================================================
-// GetRawColor1() - Translates an escape-time to a pixel-shade
+// ApplyOptions() - Applies the color inversions and the greyscale option to a pixel
 //=========================================================================================================
-pixel CShader::GetRawColor1(escape& e)
+pixel CShader::ApplyOptions(pixel result)
 {
-    if (e.iter == 0) return black;
+    // Perform Color Inversions
+    if (invert_r) result.r = 255 - result.r;
+    if (invert_g) result.g = 255 - result.g;
+    if (invert_b) result.b = 255 - result.b;
 
+    // Convert to greyscale if that option is selected
+    if (greyscale)
+    {
+        U8 shade = (U8)(result.r * .299 + result.g * .587 + result.b * .114);
+        result.r = result.g = result.b = shade;
+    }
 
-    double smoothed = log(log(e.distance) * 0.5) * ONE_OVER_LOG2;
-    double d = e.iter + 10.0 - smoothed;
+    return result;
+}
+//=========================================================================================================
 
-    double zero_to_one = fabs(sin(d * .001));
-    return m_palette[(U32)(zero_to_one * m_palette_size)];
+
+//=========================================================================================================
+// ShadeValue() - Shades a smoothed escape value with the current color scheme and shading options
+//=========================================================================================================
+pixel CShader::ShadeValue(double d)
+{
+    pixel result;
+
+    switch (m_scheme)
+    {
+        case CS_DEFAULT:
+        case CS_FIXED_HUE:  result = Shade0(d); break;
+        case CS_OBW_LINEAR: result = Shade1(d); break;
+        case CS_MONOCHROME: result = Shade2(d); break;
+        case CS_HISTOGRAM:  result = Shade4(d); break;
+        case CS_DEM:        result = Shade5(d); break;
+        default:            result = Shade3(d); break;
+    }
+
+    return ApplyOptions(result);
 }
 //=========================================================================================================
 
 
 //=========================================================================================================
-// GetRawColor2() - Translates an escape-time to a pixel-shade
+// BuildCycleLut() - Builds the color-cycling lookup table.  Its entries are the colors of escape values
+//                   spread evenly from "lo" to "hi", so with no rotation it reproduces the image
 //=========================================================================================================
-pixel CShader::GetRawColor2(escape& e)
+void CShader::BuildCycleLut(double lo, double hi)
 {
-    if (e.iter == 0) return black;
+    // Work out how escape values map to table indices
+    m_cycle_lo    = lo;
+    m_cycle_scale = (hi > lo) ? (CYCLE_LUT_SIZE - 1) / (hi - lo) : 0;
 
-    double smoothed = log(log(e.distance) * 0.5) * ONE_OVER_LOG2;
-    double d = e.iter + 10.0 - smoothed;
+    // Shade every entry of the table
+    double step = (CYCLE_LUT_SIZE > 1) ? (hi - lo) / (CYCLE_LUT_SIZE - 1) : 0;
+    for (U32 i=0; i<CYCLE_LUT_SIZE; ++i) m_cycle_lut[i] = ShadeValue(lo + i * step);
 
-    d += 50;
-    d = log(d);
-    d *= 100;
-    double p = floor(d);
-    return interpolate(palette2(p), palette2(p + 1), d - p);
+    // Interior points don't cycle
+    m_cycle_interior = ApplyOptions(black);
 }
 //=========================================================================================================
 
 
 //=========================================================================================================
-// GetRawColor3() - Translates an escape-time to a pixel-shade
+// CycleColors() - Shades an array of pixels from the color-cycling indices of their samples.  The
+//                 lookup table is rotated by "shift" entries, so every frame of the animation is nothing
+//                 more than a table lookup per sample
 //=========================================================================================================
-pixel CShader::GetRawColor3(escape& e)
+void CShader::CycleColors(const U16* index, pixel* out, U32 count, U32 shift)
 {
-    if (e.iter == 0) return black;
+    const U32 mask = CYCLE_LUT_SIZE - 1;
 
-    double smoothed = log(log(e.distance * ONE_OVER_LOG2)) * ONE_OVER_LOG2;
-    double d = sqrt(e.iter + 1 - smoothed);
+    // This is how many samples there are per pixel
+    U32 spp = ps.oversample ? ps.oversample : 1;
 
-    int colorI = (int) (d * 256) % sizeofa(m_obw_gradient);
-    return m_obw_gradient[colorI];
+    // If we aren't oversampled, each pixel is a single lookup
+    if (spp == 1)
+    {
+        for (U32 p=0; p<count; ++p)
+        {
+            U16 i  = index[p];
+            out[p] = (i == CYCLE_INTERIOR) ? m_cycle_interior : m_cycle_lut[(i + shift) & mask];
+        }
+        return;
+    }
+
+    // Otherwise, average the colors of the samples of each pixel
+    for (U32 p=0; p<count; ++p)
+    {
+        U32 r=0, g=0, b=0;
+        pixel result;
+
+        for (U32 s=0; s<spp; ++s)
+        {
+            U16 i  = *index++;
+            result = (i == CYCLE_INTERIOR) ? m_cycle_interior : m_cycle_lut[(i + shift) & mask];
+            r += result.r;
+            g += result.g;
+            b += result.b;
+        }
+
+        result.r = r / spp;
+        result.g = g / spp;
+        result.b = b / spp;
+        out[p]   = result;
+    }
 }
 //=========================================================================================================
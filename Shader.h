@@ -3,6 +3,8 @@
 //=========================================================================================================
 #pragma once
 #include "typedefs.h"
+#include <vector>
+using std::vector;
 
 //=========================================================================================================
 // Color schemes for use with "SetColorScheme"
@@ -13,11 +15,69 @@ enum
     CS_FIXED_HUE    = 1,
     CS_OBW_LINEAR   = 2,
     CS_MONOCHROME   = 3,
-    CS_OBW_GRADIENT = 4
+    CS_OBW_GRADIENT = 4,
+    CS_HISTOGRAM    = 5,
+    CS_DEM          = 6,
+
+    // User-defined gradients from the settings file are numbered from here up
+    CS_USER_GRADIENT = 7
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// A color gradient.  Its stops are positions from 0 to 1 and the color at each one, and it is baked
+// into a lookup table that repeats every GRADIENT_PERIOD units of the smoothed escape value
+//=========================================================================================================
+const U32    GRADIENT_LUT_SIZE = 8192;
+const double GRADIENT_PERIOD   = 8.0;
+
+struct gradient_stop {double x, r, g, b;};
+
+struct gradient
+{
+    CString               name;
+    vector<gradient_stop> stops;
+    vector<pixel>         lut;
+
+    // Multiplying a smoothed escape value by this gives an index into the lookup table
+    double                scale;
 };
 //=========================================================================================================
 
 
+//=========================================================================================================
+// The number of entries in the palette lookup tables.  The default and monochrome schemes look up
+// 100 * log(escape time), which stays well below this for any 32-bit iteration count
+//=========================================================================================================
+const U32 PALETTE_LUT_SIZE = 4096;
+//=========================================================================================================
+
+
+//=========================================================================================================
+// The number of entries in the distance-estimation lookup table, which covers distances from 0 to 1
+// pixel.  Anything farther from the set than that is shaded like a distance of 1 pixel
+//=========================================================================================================
+const U32 DEM_LUT_SIZE = 1024;
+//=========================================================================================================
+
+
+//=========================================================================================================
+// The number of pixels that "GetColors()" shades at a time
+//=========================================================================================================
+const U32 SHADE_BATCH = 64;
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Color cycling shades from a lookup table of this many entries (a power of 2), indexed by each
+// sample's escape value.  CYCLE_INTERIOR is the index of a sample that never escaped
+//=========================================================================================================
+const U32 CYCLE_LUT_SIZE = 4096;
+const U16 CYCLE_INTERIOR = 0xFFFF;
+//=========================================================================================================
+
+
 //=========================================================================================================
 // CShader - Defines the pixel shader
 //=========================================================================================================
@@ -34,8 +94,11 @@ public:
     // Fetches the color scheme
     int     GetScheme() {return m_scheme;}
 
-    // Returns a color that corresponds to the current color scheme
-    pixel   GetColor(frac_value& v);
+    // Chooses the shading pipeline that suits the current color scheme and shading options
+    void    SelectPipeline();
+
+    // Fetches the colors that correspond to an array of fractal values and the current color scheme
+    void    GetColors(const frac_value* v, pixel* out, U32 count);
 
     // Call this to set the fixed-hue for fixed-hue color schemes
     void    SetFixedHue(double hue);
@@ -43,6 +106,38 @@ public:
     // Initializes the scheme names into a combo-box
     void    InitSchemeNames(CComboBox* pCB);
 
+    // Adds a user-defined gradient color scheme.  Returns false if the stops don't make a gradient
+    bool    AddGradient(CString name, const vector<gradient_stop>& stops);
+
+    // Adds the names of the user-defined gradients to the color scheme combo-box
+    void    AddGradientNames(CComboBox* pCB);
+
+    // Returns the list of user-defined gradients
+    const vector<gradient>& GetGradients() {return m_user_gradient;}
+
+    // Sets the histogram of escape counts that the histogram-equalized scheme shades with.  Entry "n"
+    // is the number of samples that escaped after "n * width" to "n * width + width - 1" iterations
+    void    SetHistogram(const vector<U64>& histogram, U32 width);
+
+    // Computes the smoothed escape value of every sample of an array of fractal values with the current
+    // color scheme.  "d" must have room for "count" times the number of samples per pixel
+    void    GetEscapeValues(const frac_value* v, U32 count, double* d);
+
+    // Builds the color-cycling lookup table, spread across escape values from "lo" to "hi"
+    void    BuildCycleLut(double lo, double hi);
+
+    // Returns the color-cycling lookup table index of a smoothed escape value
+    U16     CycleIndex(double d)
+    {
+        double i = (d - m_cycle_lo) * m_cycle_scale + 0.5;
+        if (!(i > 0)) return 0;
+        return (i < CYCLE_LUT_SIZE - 1) ? (U16)i : (U16)(CYCLE_LUT_SIZE - 1);
+    }
+
+    // Shades an array of pixels from their color-cycling indices, with the lookup table rotated by
+    // "shift" entries
+    void    CycleColors(const U16* index, pixel* out, U32 count, U32 shift);
+
     // Dumps a .bmp file of the palette for debugging purposes
     void    DumpPalette();
     
@@ -52,22 +147,58 @@ protected:
     pixel   palette0(double d);
     pixel   palette2(double d);
 
+    // Fills in the lookup tables for "palette0()" and "palette2()"
+    void    BuildPalette0Lut();
+    void    BuildPalette2Lut();
+
+    // Fills in the lookup table for distance-estimation shading
+    void    BuildDemLut();
+
     // Initializes the OBW_PALETTE color scheme
     void    Init_OBW_LINEAR();
 
     // Initializes the Orange/Blue/White gradient
     void    Init_OBW_Gradient();
     
-    // Routines for translating an mandelbrot escape value to a pixel shade
-    pixel   GetRawColor (escape& e);
-    pixel   GetRawColor0(escape& e);
-    pixel   GetRawColor1(escape& e);
-    pixel   GetRawColor2(escape& e);
-    pixel   GetRawColor3(escape& e);
+    // A shading pipeline: a "GetColors()" that is specialized for one combination of settings
+    typedef void (CShader::*pipeline)(const frac_value* v, pixel* out, U32 count);
+
+    // The pipelines for every combination of color scheme, inverted channels, greyscale, and samples
+    // per pixel, and the routines that pick one of them
+    template <int SCHEME, int INVERT, bool GREY, U32 SPP>
+    void    ShadePipeline(const frac_value* v, pixel* out, U32 count);
+    template <int SCHEME, int INVERT, bool GREY>
+    pipeline SelectSpp(U32 oversample);
+    template <int SCHEME, int INVERT>
+    pipeline SelectGrey(bool grey, U32 oversample);
+    template <int SCHEME>
+    pipeline SelectInvert(int invert, bool grey, U32 oversample);
+
+    // Translates a smoothed mandelbrot escape value to a pixel shade, and applies the shading options
+    template <int SCHEME, int INVERT, bool GREY>
+    pixel   ShadeSample(const escape& e, double d);
+
+    // Routines for translating a smoothed mandelbrot escape value to a pixel shade
+    pixel   Shade0(double d);
+    pixel   Shade1(double d);
+    pixel   Shade2(double d);
+    pixel   Shade3(double d);
+    pixel   Shade4(double d);
+    pixel   Shade5(double d);
+    pixel   Shade5Interior(double d);
+
+    // Shades a smoothed escape value with the current color scheme and shading options
+    pixel   ShadeValue(double d);
+
+    // Applies the color inversions and greyscale option to a pixel
+    pixel   ApplyOptions(pixel result);
 
     // Current color scheme ID
     int     m_scheme;
 
+    // The shading pipeline chosen by "SelectPipeline()"
+    pipeline m_pipeline;
+
     // The fixed hue for fixed-hue coloring schemes
     double  m_fixed_hue;
 
@@ -75,9 +206,36 @@ protected:
     pixel   m_palette[2000];
 
     // The orange/blue/white gradient
-    pixel   m_obw_gradient[2048];
+    gradient m_obw_gradient;
+
+    // The user-defined gradients
+    vector<gradient> m_user_gradient;
+
+    // The gradient that the gradient color schemes shade with.  Switching schemes just swaps this
+    const gradient* m_gradient;
+
+    // For histogram-equalized shading: entry "n" is the fraction of escaped samples that escaped in
+    // fewer than "n" times "m_cdf_scale" iterations
+    vector<double> m_cdf;
+    double         m_cdf_scale;
 
     // Number of entries in current palette
     U32     m_palette_size;
+
+    // The color-cycling lookup table, the color of interior points, and the mapping from smoothed escape
+    // values to table indices
+    pixel   m_cycle_lut[CYCLE_LUT_SIZE];
+    pixel   m_cycle_interior;
+    double  m_cycle_lo;
+    double  m_cycle_scale;
+
+    // "palette0()" and "palette2()" evaluated at every whole number from 0 to PALETTE_LUT_SIZE - 1
+    pixel   m_palette0_lut[PALETTE_LUT_SIZE];
+    pixel   m_palette2_lut[PALETTE_LUT_SIZE];
+
+    // The colors of distances from 0 to 1 pixel, for distance-estimation shading outside and inside
+    // the set
+    pixel   m_dem_lut[DEM_LUT_SIZE];
+    pixel   m_dem_interior_lut[DEM_LUT_SIZE];
 };
 //=========================================================================================================
\ No newline at end of file
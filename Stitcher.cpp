@@ -2,8 +2,10 @@
 #include "Stitcher.h"
 #include "Globals.h"
 #include "WinUtilsImp.h"
-#include <vector>
-using std::vector;
+
+// Unless a block holds the whole image, its height is a multiple of this, so that the blocks will
+// start on a tile boundary in any of our tiled output formats
+static const U32 STITCH_BLOCK_ALIGN = TIFF_TILE_SIZE;
 
 
 //=========================================================================================================
@@ -37,6 +39,9 @@ struct sfile
     FILE*   ifile;
     U32     pixel_bytes;
     U32     padding_bytes;
+    U32     pixel_offset;
+    U32     left;
+    U32     cols;
 };
 //=========================================================================================================
 
@@ -69,7 +74,7 @@ void CStitcher::Init()
 void CStitcher::AddFile(CString fn)
 {
     // Create an sfile record from the filename we were passed
-    sfile sf = {fn, nullptr, 0};
+    sfile sf = {fn, nullptr, 0, 0, 0, 0, 0};
 
     // And add this to the list of files we are going to stitch together
     fvec.push_back(sf);
@@ -129,8 +134,15 @@ bool CStitcher::OpenFiles()
             return false;
         }
 
-        // Read in the bitmap header
-        fread(&bmp, 1, sizeof bmp, sf.ifile);
+        // Read in the bitmap header.  Every file must be a 24-bit, bottom-up BMP, and they must all be
+        // the same height
+        if (fread(&bmp, 1, sizeof bmp, sf.ifile) != sizeof bmp
+        ||  bmp.magic[0] != 'B' || bmp.magic[1] != 'M' || bmp.bitcount != 24 || bmp.height <= 0
+        ||  (i > 0 && (U32)bmp.height != m_out_rows))
+        {
+            CloseFiles();
+            return false;
+        }
 
         // Compute how many bytes of pixels each row has
         sf.pixel_bytes = bmp.width * 3;
@@ -138,6 +150,13 @@ bool CStitcher::OpenFiles()
         // Compute how many bytes of padding each row has
         sf.padding_bytes = (4 - sf.pixel_bytes % 4) % 4;
 
+        // Remember where the pixels start in the file
+        sf.pixel_offset = bmp.pixel_offset;
+
+        // This file holds these columns of the output file
+        sf.left = m_out_cols;
+        sf.cols = bmp.width;
+
         // Keep track of the total number of columns in our eventual output file
         m_out_cols += bmp.width;
 
@@ -145,11 +164,6 @@ bool CStitcher::OpenFiles()
         m_out_rows = bmp.height;
     }
 
-
-    // Compute the number of bytes in a row, including padding
-    m_padded_row_length = m_out_cols * 3;
-    while (m_padded_row_length % 4) ++m_padded_row_length;
-
     // Tell the caller that all of the input files are open
     return TRUE;
 }
@@ -158,47 +172,53 @@ bool CStitcher::OpenFiles()
 
 
 //=========================================================================================================
-// CreateOutputFile() - Creates and output BMP file and writes its header
+// ReadBlock() - Reads rows "top" through "top + rows - 1" of the output image from the input files, with
+//               one read per file, and converts them into a block of pixels
 //=========================================================================================================
-FILE* CStitcher::CreateOutputFile(CString fn, U32 cols, U32 rows)
+bool CStitcher::ReadBlock(pixel* block, U32 top, U32 rows)
 {
-    BITMAPHDR   hdr;
-    FILE*       ofile = nullptr;
-
-    // Create the output file;
-    if (_wfopen_s(&ofile, fn, L"wb") != 0) return nullptr;
+    // Rows are stored in the files from bottom to top, so this is the scanline of the bottom row of the
+    // block.  The rest of the block follows it in each file
+    U32 first_scanline = m_out_rows - top - rows;
 
-    // Create the bitmap header we're about to write
-    memset(&hdr, 0, sizeof hdr);
-
-    // Fill in the signature
-    hdr.magic[0] = 'B';
-    hdr.magic[1] = 'M';
-
-    // Fill in the total size of the file
-    hdr.total_size = sizeof(hdr) + m_padded_row_length * rows;
-
-    // Offset (in the file) to the pixel data
-    hdr.pixel_offset = sizeof hdr;
-
-    // Fill in the dimensions of the image
-    hdr.width = cols;
-    hdr.height = rows;
-
-    // We're using the standard 40-byte BMP image header
-    hdr.hdr_size = 40;
+    // Loop through each input file...
+    for (U32 file = 0; file < fvec.size(); ++file)
+    {
+        // Get a handy reference to this sfile record
+        sfile& sf = fvec[file];
 
-    // Only 1 bitplane
-    hdr.planes = 1;
+        // This is the length of a row in this file, including padding bytes
+        U32 row_length = sf.pixel_bytes + sf.padding_bytes;
 
-    // We're writing 24 bits per pixel
-    hdr.bitcount = 24;
+        // Read the entire block of rows in one go
+        size_t length = (size_t)rows * row_length;
+        if (m_raw.size() < length) m_raw.resize(length);
+        _fseeki64(sf.ifile, sf.pixel_offset + (U64)first_scanline * row_length, SEEK_SET);
+        if (fread(m_raw.data(), 1, length, sf.ifile) != length) return false;
 
-    // Write the file header to the file
-    fwrite(&hdr, 1, sizeof hdr , ofile);
+        // Loop through each row we just read...
+        for (U32 i = 0; i < rows; ++i)
+        {
+            // Point to the first pixel of this row in the file
+            const U8* in = m_raw.data() + (size_t)i * row_length;
+
+            // Point to where that pixel goes in the block.  The last row in the file is the top row
+            pixel* p_pixel = block + (U64)(rows - 1 - i) * m_out_cols + sf.left;
+
+            // And convert the row
+            for (U32 x = 0; x < sf.cols; ++x)
+            {
+                p_pixel->b = *in++;
+                p_pixel->g = *in++;
+                p_pixel->r = *in++;
+                p_pixel->a = 0;
+                ++p_pixel;
+            }
+        }
+    }
 
-    // Hand the output FILE* to the caller
-    return ofile;
+    // Tell the caller that all is well
+    return true;
 }
 //=========================================================================================================
 
@@ -206,64 +226,79 @@ FILE* CStitcher::CreateOutputFile(CString fn, U32 cols, U32 rows)
 //=========================================================================================================
 // Stitch() - Stitches together all of the input files into a single output file
 //=========================================================================================================
-bool CStitcher::Stitch(CString output_fn)
+bool CStitcher::Stitch(CString output_fn, U32 format)
 {
-    // If there's only one input file, no stitching required
-    if (fvec.size() == 1)
-    {
-        DeleteFile(output_fn);
-        MoveFile(fvec[0].fn, output_fn);
-        return true;
-    }
+    // If there's only one input file and we're writing a BMP file, no stitching required
+    if (fvec.size() == 1 && format == OF_BMP) return CopyFile(fvec[0].fn, output_fn, FALSE) != 0;
 
     // Open all of the input files
     if (!OpenFiles()) return FALSE;
 
-    // Create the output file
-    FILE* ofile = CreateOutputFile(output_fn, m_out_cols, m_out_rows);
+    // Each row of a block costs this many bytes: the two halves of the block buffer, and the one row of
+    // raw pixels from each input file
+    U64 row_cost = (U64)m_out_cols * (2 * sizeof(pixel) + 3);
 
-    // If we couldn't create the output file, close the inputs and tell the caller
-    if (ofile == nullptr)
+    // Decide how many rows go into each block, within the memory budget
+    U64 budget_rows = (U64)memory_budget * 1024 * 1024 / row_cost;
+    U32 block_rows;
+    if (budget_rows >= m_out_rows)
+        block_rows = m_out_rows;
+    else if (format == OF_TIFF || format == OF_DZI)
     {
-        CloseFiles(true);
-        return FALSE;
+        // Blocks of a tiled image must start on a tile boundary.  If not even one row of tiles fits in
+        // the budget, we go over the budget rather than give up
+        block_rows = (U32)(budget_rows - budget_rows % STITCH_BLOCK_ALIGN);
+        if (block_rows == 0) block_rows = (m_out_rows < STITCH_BLOCK_ALIGN) ? m_out_rows : STITCH_BLOCK_ALIGN;
     }
+    else
+        block_rows = budget_rows ? (U32)budget_rows : 1;
+
+    // Allocate the two halves of the block buffer
+    U64    block_size = (U64)block_rows * m_out_cols;
+    pixel* buffer     = block_rows ? (pixel*)AllocateBuffer(2 * block_size * sizeof(pixel)) : nullptr;
 
-    // Loop through each row of the bitmap
-    for (U32 row = 0; row < m_out_rows; ++row)
+    // Create the output file
+    if (buffer == nullptr || !PanelWriter.Open(output_fn, format, m_out_cols, m_out_rows))
     {
-        // Point to the buffer we're we will collect pixels
-        U8* p = (U8*)panel;
-       
-        // Loop through each input file
-        for (U32 file = 0; file < fvec.size(); ++file)
-        {
-            // Get a handy reference to this sfile record
-            sfile& sf = fvec[file];
+        FreeBuffer(buffer);
+        CloseFiles();
+        return FALSE;
+    }
 
-            // Read in an entire row of pixels (plus padding bytes)
-            fread(p, 1, sf.pixel_bytes + sf.padding_bytes, sf.ifile);
+    // Loop through each block of rows, from the top of the image down...
+    for (U32 top = 0, block = 0; top < m_out_rows; top += block_rows, ++block)
+    {
+        // The last block may be short
+        U32 rows = m_out_rows - top;
+        if (rows > block_rows) rows = block_rows;
 
-            // Move our pointer to the end of the pixels we just read in
-            p += sf.pixel_bytes;
+        // Read it into whichever half of the block buffer isn't being written to disk
+        pixel* p_block = buffer + (block % 2) * block_size;
+        if (!ReadBlock(p_block, top, rows) || !PanelWriter.Wait())
+        {
+            PanelWriter.Close(true);
+            FreeBuffer(buffer);
+            CloseFiles();
+            return FALSE;
         }
 
-        // Append some padding bytes to the end of the row of pixels
-        *p++ = 0;
-        *p++ = 0;
-        *p++ = 0;
-
-        // And write this row of pixels to the output file
-        fwrite(panel, 1, m_padded_row_length, ofile);
+        // Hand it to the writer thread.  It will be written while we read the next block
+        PanelWriter.Start(p_block, nullptr, 0, top, m_out_cols, rows);
     }
 
-    // Close the output file
-    fclose(ofile);
+    // Wait for the last block to be written, and close the output file
+    bool ok = PanelWriter.Close();
 
-    // Close all of the input files
-    CloseFiles(true);
+    // We're done with the block buffer
+    FreeBuffer(buffer);
+    m_raw.clear();
+    m_raw.shrink_to_fit();
 
-    // And tell the caller that we have just stitched together an output file
-    return true;
+    // Close all of the input files.  Once the output is safely written, the caller can delete them
+    // with "Cleanup()"
+    CloseFiles();
+
+    // And tell the caller whether we have just stitched together an output file
+    return ok;
 }
 //=========================================================================================================
@@ -1,9 +1,17 @@
 #pragma once
 #include "stdafx.h"
 #include "typedefs.h"
+#include <vector>
+using std::vector;
 
 //=========================================================================================================
-// class CStitcher - Stitches bitmap files together
+// class CStitcher - Stitches bitmap files together.  The files are side-by-side vertical strips of the
+//                   image, all the same height.
+//
+// The image is assembled a block of rows at a time: one bulk read from each input file fills a block,
+// and the block is handed to the panel-writer thread, which writes it into the output image while the
+// next block is being read into the other half of a double buffer.  Since it uses the panel-writer
+// thread, stitching must not be done while a render is running.
 //=========================================================================================================
 class CStitcher
 {
@@ -18,8 +26,9 @@ public:
     // Call this to add a file
     void    AddFile(CString fn);
 
-    // Call this to stitch those files together
-    bool    Stitch(CString new_fn);
+    // Call this to stitch those files together into an image in one of the OF_xxx formats.  Returns
+    // false if the image couldn't be completely written.  The input files are left alone
+    bool    Stitch(CString new_fn, U32 format);
 
     // Call this to delete files that have been added via AddFile()
     void    Cleanup() {CloseFiles(true);}
@@ -32,14 +41,14 @@ protected:
     // Call this to close all of the files
     void    CloseFiles(bool erase = false);
 
-    // Create the output file, including writing the header
-    FILE*   CreateOutputFile(CString fn, U32 cols, U32 rows);
+    // Reads one block of rows from every input file into a block of the output image
+    bool    ReadBlock(pixel* block, U32 top, U32 rows);
 
     // Number of rows and columns in the output file
     U32     m_out_cols;
     U32     m_out_rows;
 
-    // The length (in bytes) of a row of pixels, including padding bytes
-    U32     m_padded_row_length;
+    // A buffer that holds one block of rows from one input file, exactly as they are in the file
+    vector<U8> m_raw;
 };
 //=========================================================================================================
\ No newline at end of file
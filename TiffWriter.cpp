@@ -0,0 +1,338 @@
+//=========================================================================================================
+// TiffWriter.cpp - Writes rendered images as tiled, deflate-compressed BigTIFF files
+//
+// A BigTIFF file is laid out like this:
+//
+//     16-byte header, which holds the file offset of the image file directory
+//     Compressed tiles, in the order they were rendered
+//     The tile offset and tile byte-count tables
+//     The image file directory (IFD)
+//
+// Because we don't know where the tiles will land until they've been compressed, the tables and the
+// directory are written last and the header is then patched to point to the directory.
+//=========================================================================================================
+#include "stdafx.h"
+#include "TiffWriter.h"
+#include "Deflate.h"
+#include "Globals.h"
+
+//=========================================================================================================
+// TIFF tags and field types that we use
+//=========================================================================================================
+enum
+{
+    TAG_IMAGE_WIDTH       = 256,
+    TAG_IMAGE_LENGTH      = 257,
+    TAG_BITS_PER_SAMPLE   = 258,
+    TAG_COMPRESSION       = 259,
+    TAG_PHOTOMETRIC       = 262,
+    TAG_SAMPLES_PER_PIXEL = 277,
+    TAG_PLANAR_CONFIG     = 284,
+    TAG_PREDICTOR         = 317,
+    TAG_TILE_WIDTH        = 322,
+    TAG_TILE_LENGTH       = 323,
+    TAG_TILE_OFFSETS      = 324,
+    TAG_TILE_BYTE_COUNTS  = 325
+};
+
+enum
+{
+    TYPE_SHORT = 3,
+    TYPE_LONG  = 4,
+    TYPE_LONG8 = 16
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// This is the structure of the header of a BigTIFF file
+//=========================================================================================================
+#pragma pack(push, 1)
+struct BIGTIFFHDR
+{
+    U8  byte_order[2];
+    U16 version;
+    U16 offset_size;
+    U16 reserved;
+    U64 ifd_offset;
+};
+//=========================================================================================================
+
+
+//=========================================================================================================
+// This is the structure of an entry in a BigTIFF image file directory
+//=========================================================================================================
+struct BIGTIFFENTRY
+{
+    U16 tag;
+    U16 type;
+    U64 count;
+    U64 value;
+};
+#pragma pack(pop)
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Create() - Creates the output file and writes a header.  The header will be re-written when the
+//            file is closed
+//=========================================================================================================
+bool CTiffWriter::Create(CString fn, U32 cols, U32 rows)
+{
+    BIGTIFFHDR hdr;
+
+    // Make sure any file we previously had open is closed
+    Close();
+
+    // Create and open the output file
+    if (!m_file.Create(fn)) return false;
+
+    // Keep track of the image dimensions
+    m_cols = cols;
+    m_rows = rows;
+
+    // Determine how many tiles it takes to cover the image
+    m_tiles_across = (cols + TIFF_TILE_SIZE - 1) / TIFF_TILE_SIZE;
+    m_tiles_down   = (rows + TIFF_TILE_SIZE - 1) / TIFF_TILE_SIZE;
+
+    // None of the tiles have been written yet
+    m_tile_offset.assign((U64)m_tiles_across * m_tiles_down, 0);
+    m_tile_size.assign((U64)m_tiles_across * m_tiles_down, 0);
+
+    // Each encoder thread gets a buffer big enough to hold one uncompressed tile
+    m_raw.resize(MAX_THREADS);
+
+    // Fill in a header.  We don't know where the directory is yet
+    memset(&hdr, 0, sizeof hdr);
+    hdr.byte_order[0] = 'I';
+    hdr.byte_order[1] = 'I';
+    hdr.version       = 43;
+    hdr.offset_size   = 8;
+
+    // Write the header to the file
+    if (!m_file.Write(&hdr, sizeof hdr))
+    {
+        Close(true);
+        return false;
+    }
+
+    // Tell the caller that all is well
+    return true;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// EncodeItem() - Called by encoder thread "thread" to compress tile number "item" of the current panel
+//=========================================================================================================
+void CTiffWriter::EncodeItem(U32 item, U32 thread)
+{
+    const U32 row_length = TIFF_TILE_SIZE * 3;
+
+    // Find the upper-left corner of this tile within the panel
+    U32 tile_x = (item % m_panel_tiles_across) * TIFF_TILE_SIZE;
+    U32 tile_y = (item / m_panel_tiles_across) * TIFF_TILE_SIZE;
+
+    // Find out how much of this tile lies inside the panel.  The rest is padding
+    U32 cols = m_panel_cols - tile_x;
+    U32 rows = m_panel_rows - tile_y;
+    if (cols > TIFF_TILE_SIZE) cols = TIFF_TILE_SIZE;
+    if (rows > TIFF_TILE_SIZE) rows = TIFF_TILE_SIZE;
+
+    // Get a reference to this thread's tile buffer, and make sure the padding is all zeros
+    vector<U8>& raw = m_raw[thread];
+    raw.assign(row_length * TIFF_TILE_SIZE, 0);
+
+    // Loop through each row of the tile...
+    for (U32 y=0; y<rows; ++y)
+    {
+        // Point to the first pixel of this row of the tile
+        pixel* p_pixel = m_bitmap + (U64)(tile_y + y) * m_panel_cols + tile_x;
+
+        // Point to where this row goes in the tile buffer
+        U8* out = raw.data() + y * row_length;
+
+        // Each sample is stored as the difference between it and the same sample of the pixel to its
+        // left (TIFF "horizontal differencing").  This makes smooth gradients much more compressible
+        U8 r = 0, g = 0, b = 0;
+
+        for (U32 x=0; x<cols; ++x)
+        {
+            *out++ = p_pixel->r - r;
+            *out++ = p_pixel->g - g;
+            *out++ = p_pixel->b - b;
+            r = p_pixel->r;
+            g = p_pixel->g;
+            b = p_pixel->b;
+            ++p_pixel;
+        }
+
+        // The padding to the right of the image must be differenced too
+        if (cols < TIFF_TILE_SIZE)
+        {
+            *out++ = 0 - r;
+            *out++ = 0 - g;
+            *out++ = 0 - b;
+        }
+    }
+
+    // Compress the tile into its own zlib stream
+    m_packed[item].clear();
+    ZlibCompress(raw.data(), raw.size(), m_packed[item]);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WritePanel() - Compresses each tile of a panel and appends it to the file
+//=========================================================================================================
+bool CTiffWriter::WritePanel(pixel* bitmap, U32 left, U32 top, U32 cols, U32 rows)
+{
+    bool ok = true;
+
+    // If the output file isn't open, we can't write anything
+    if (!m_file.IsOpen()) return false;
+
+    // Record the panel we're about to compress
+    m_bitmap     = bitmap;
+    m_left       = left;
+    m_top        = top;
+    m_panel_cols = cols;
+    m_panel_rows = rows;
+
+    // Determine how many tiles make up this panel
+    m_panel_tiles_across = (cols + TIFF_TILE_SIZE - 1) / TIFF_TILE_SIZE;
+    U32 panel_tiles_down = (rows + TIFF_TILE_SIZE - 1) / TIFF_TILE_SIZE;
+    U32 tile_count       = m_panel_tiles_across * panel_tiles_down;
+
+    // Make room for the compressed tiles
+    m_packed.resize(tile_count);
+
+    // Start the encoder threads compressing tiles
+    CEncoder::StartJob(this, tile_count);
+
+    // As each tile finishes compressing (in order), write it to the file
+    for (U32 item=0; item<tile_count; ++item)
+    {
+        // Wait for this tile to be compressed
+        CEncoder::WaitForItem(item);
+
+        // Find out where this tile lives in the image
+        U32 tile_x = left / TIFF_TILE_SIZE + item % m_panel_tiles_across;
+        U32 tile_y = top  / TIFF_TILE_SIZE + item / m_panel_tiles_across;
+        U64 index  = (U64)tile_y * m_tiles_across + tile_x;
+
+        // Write the tile to the end of the file and record where we put it
+        vector<U8>& packed = m_packed[item];
+        U64 position = m_file.Tell();
+        if (ok && m_file.Write(packed.data(), packed.size()))
+        {
+            m_tile_offset[index] = position;
+            m_tile_size[index]   = packed.size();
+        }
+        else ok = false;
+
+        // We're done with the compressed data
+        packed.clear();
+        packed.shrink_to_fit();
+    }
+
+    // Tell the caller whether all is well
+    return ok;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// WriteDirectory() - Writes the tile tables and the image file directory, then points the header at
+//                    the directory
+//=========================================================================================================
+bool CTiffWriter::WriteDirectory()
+{
+    vector<BIGTIFFENTRY> dir;
+    BIGTIFFENTRY         entry;
+    U64                  tile_count = m_tile_offset.size();
+
+    // If there is more than one tile, the tile tables are stored outside of the directory
+    U64 position         = m_file.Tell();
+    U64 offsets_position = position;
+    U64 sizes_position   = position + tile_count * sizeof(U64);
+    U64 dir_position     = position + 2 * tile_count * sizeof(U64);
+
+    if (tile_count > 1)
+    {
+        m_file.Write(m_tile_offset.data(), tile_count * sizeof(U64));
+        m_file.Write(m_tile_size.data(),   tile_count * sizeof(U64));
+    }
+    else
+    {
+        offsets_position = m_tile_offset[0];
+        sizes_position   = m_tile_size[0];
+        dir_position     = position;
+    }
+
+    // Entries in the directory must be in ascending tag order
+    entry.tag = TAG_IMAGE_WIDTH;       entry.type = TYPE_LONG;  entry.count = 1; entry.value = m_cols; dir.push_back(entry);
+    entry.tag = TAG_IMAGE_LENGTH;      entry.type = TYPE_LONG;  entry.count = 1; entry.value = m_rows; dir.push_back(entry);
+
+    // Three 8-bit samples per pixel.  Three SHORTs fit inside the entry
+    entry.tag = TAG_BITS_PER_SAMPLE;   entry.type = TYPE_SHORT; entry.count = 3;
+    entry.value = 8 | (8 << 16) | ((U64)8 << 32);
+    dir.push_back(entry);
+
+    // Deflate compression, RGB pixels, with the samples of each pixel stored together
+    entry.tag = TAG_COMPRESSION;       entry.type = TYPE_SHORT; entry.count = 1; entry.value = 8; dir.push_back(entry);
+    entry.tag = TAG_PHOTOMETRIC;       entry.type = TYPE_SHORT; entry.count = 1; entry.value = 2; dir.push_back(entry);
+    entry.tag = TAG_SAMPLES_PER_PIXEL; entry.type = TYPE_SHORT; entry.count = 1; entry.value = 3; dir.push_back(entry);
+    entry.tag = TAG_PLANAR_CONFIG;     entry.type = TYPE_SHORT; entry.count = 1; entry.value = 1; dir.push_back(entry);
+
+    // Samples are stored using horizontal differencing
+    entry.tag = TAG_PREDICTOR;         entry.type = TYPE_SHORT; entry.count = 1; entry.value = 2; dir.push_back(entry);
+
+    // The tile geometry and the tables that tell where each tile lives
+    entry.tag = TAG_TILE_WIDTH;        entry.type = TYPE_LONG;  entry.count = 1; entry.value = TIFF_TILE_SIZE; dir.push_back(entry);
+    entry.tag = TAG_TILE_LENGTH;       entry.type = TYPE_LONG;  entry.count = 1; entry.value = TIFF_TILE_SIZE; dir.push_back(entry);
+    entry.tag = TAG_TILE_OFFSETS;      entry.type = TYPE_LONG8; entry.count = tile_count; entry.value = offsets_position; dir.push_back(entry);
+    entry.tag = TAG_TILE_BYTE_COUNTS;  entry.type = TYPE_LONG8; entry.count = tile_count; entry.value = sizes_position;   dir.push_back(entry);
+
+    // Write the directory: the entry count, the entries, and the offset of the next directory (none)
+    U64 entry_count = dir.size(), next_dir = 0;
+    m_file.Write(&entry_count, sizeof entry_count);
+    m_file.Write(dir.data(), dir.size() * sizeof(BIGTIFFENTRY));
+    if (!m_file.Write(&next_dir, sizeof next_dir)) return false;
+
+    // And point the header to the directory
+    m_file.Seek(offsetof(BIGTIFFHDR, ifd_offset));
+    return m_file.Write(&dir_position, sizeof dir_position);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Close() - Writes the image file directory and closes the output file, or optionally deletes it
+//=========================================================================================================
+bool CTiffWriter::Close(bool erase)
+{
+    bool ok = true;
+
+    // If the file is open, finish it and close it
+    if (m_file.IsOpen())
+    {
+        // If we're going to keep this file, it needs a directory
+        if (!erase && !WriteDirectory()) {erase = true; ok = false;}
+
+        // Wait for our writes to finish and close the file.  If we've been asked to (or couldn't finish
+        // the file), it is deleted
+        if (!m_file.Close(erase) && !erase) ok = false;
+    }
+
+    // Free our buffers
+    m_tile_offset.clear();
+    m_tile_size.clear();
+    m_raw.clear();
+    m_packed.clear();
+
+    // Tell the caller whether the file was completely written
+    return ok;
+}
+//=========================================================================================================
@@ -0,0 +1,72 @@
+//=========================================================================================================
+// TiffWriter.h - Describes the class that writes rendered images as tiled, compressed BigTIFF files
+//=========================================================================================================
+#pragma once
+#include "Image.h"
+#include "Encoder.h"
+
+// The width and height (in pixels) of a tile in a TIFF file
+#define TIFF_TILE_SIZE 512
+
+//=========================================================================================================
+// CTiffWriter - Writes panels of pixels into a tiled BigTIFF file.  Every panel must start on a tile
+//               boundary, and must be a whole number of tiles wide and tall unless it reaches the right
+//               or bottom edge of the image.  The tiles of each panel are compressed in parallel by the
+//               encoder threads and are appended to the file as they complete.  The directory that
+//               tells a reader where each tile lives is written when the file is closed.
+//=========================================================================================================
+class CTiffWriter : public CImageWriter, public CEncodeJob
+{
+public:
+
+    // Default constructor
+    CTiffWriter() {}
+
+    // Destructor closes the file if it's still open
+    ~CTiffWriter() {Close();}
+
+    // Creates the output file and writes the header
+    bool    Create(CString fn, U32 cols, U32 rows);
+
+    // Compresses the tiles of a panel and appends them to the file
+    bool    WritePanel(pixel* bitmap, U32 left, U32 top, U32 cols, U32 rows);
+
+    // Writes the image directory and closes the file, optionally deleting it.  Returns false if the
+    // file couldn't be completely written
+    bool    Close(bool erase = false);
+
+    // Called by the encoder threads to compress one tile of the current panel
+    void    EncodeItem(U32 item, U32 thread);
+
+protected:
+
+    // Writes the image file directory
+    bool    WriteDirectory();
+
+    // The output file.  Tiles are always appended, so its position is the end of the file
+    CAsyncFile m_file;
+
+    // Dimensions of the complete image
+    U32     m_cols;
+    U32     m_rows;
+
+    // The number of tiles across and down the complete image
+    U32     m_tiles_across;
+    U32     m_tiles_down;
+
+    // The file offset and compressed size of every tile in the image
+    vector<U64> m_tile_offset;
+    vector<U64> m_tile_size;
+
+    // The panel currently being encoded, and how many tiles across it is
+    pixel*  m_bitmap;
+    U32     m_left, m_top, m_panel_cols, m_panel_rows;
+    U32     m_panel_tiles_across;
+
+    // One buffer per encoder thread for building an uncompressed tile
+    vector<vector<U8>> m_raw;
+
+    // The compressed data for each tile of the current panel
+    vector<vector<U8>> m_packed;
+};
+//=========================================================================================================
@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include "cmspline.h"
+#include <algorithm>
+#include <emmintrin.h>
 
 //=========================================================================================================
 // CreateInterpolant() - Creates the interpolating coefficients
@@ -69,6 +71,41 @@ void CubicMonoSpline::CreateInterpolant(double* xs, double* ys, unsigned length)
 //=========================================================================================================
 
 
+//=========================================================================================================
+// FindSegment() - Finds the segment that x falls into by binary search.  Segment i runs from m_xs[i] up
+//                 to m_xs[i + 1].  X values outside the spline use the first or last segment
+//=========================================================================================================
+unsigned CubicMonoSpline::FindSegment(double x)
+{
+    unsigned segments = (unsigned)m_c3s.size();
+
+    // Find the first interior point that is past x.  The segment we want ends there
+    auto it = std::upper_bound(m_xs.begin() + 1, m_xs.begin() + segments, x);
+    return (unsigned)(it - m_xs.begin()) - 1;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// FindSegment() - Finds the segment that x falls into.  When x values arrive in ascending order, x is
+//                 almost always in segment "hint" or the one after it, so we check those first
+//=========================================================================================================
+unsigned CubicMonoSpline::FindSegment(double x, unsigned hint)
+{
+    unsigned last = (unsigned)m_c3s.size() - 1;
+
+    // Is x in the segment we were given?
+    if ((hint == 0 || x >= m_xs[hint]) && (hint == last || x < m_xs[hint + 1])) return hint;
+
+    // Is x in the segment after it?
+    if (hint < last && x >= m_xs[hint + 1] && (hint + 1 == last || x < m_xs[hint + 2])) return hint + 1;
+
+    // Otherwise, go look for it
+    return FindSegment(x);
+}
+//=========================================================================================================
+
+
 //=========================================================================================================
 // Interpolate() - Interpolates a Y value from the specified X value
 //=========================================================================================================
@@ -80,20 +117,8 @@ double CubicMonoSpline::Interpolate(double x)
     // If we were passed in the last 'X' value of our definition, return the corresponding 'Y'
     if (x == m_xs[i])  return m_ys[i];
 
-    // Search for the interval x is in, returning the corresponding y if x is one of the original xs
-    unsigned  low = 0, mid, high = (unsigned)m_c3s.size() - 1;
-    while (low <= high)
-    {
-        mid = (low + high) / 2;
-        double xHere = m_xs[mid];
-        if (xHere < x)
-            low = mid + 1;
-        else if (xHere > x)
-            high = mid - 1;
-        else
-            return m_ys[mid];
-    }
-    i = max(0, high);
+    // Find the interval x is in
+    i = FindSegment(x);
 
     // Interpolate
     double diff = x - m_xs[i];
@@ -101,3 +126,81 @@ double CubicMonoSpline::Interpolate(double x)
     return m_ys[i] + m_c1s[i] * diff + m_c2s[i] * diffSq + m_c3s[i] * diff*diffSq;
 };
 //=========================================================================================================
+
+
+//=========================================================================================================
+// Interpolate() - Interpolates the Y value for each of an array of X values.  The segments are found
+//                 first, then the cubics are evaluated two at a time with SSE2
+//=========================================================================================================
+void CubicMonoSpline::Interpolate(const double* x, double* y, unsigned count)
+{
+    const unsigned BATCH = 64;
+    unsigned       segment[BATCH];
+    unsigned       hint = 0;
+
+    // This is the last point in the dataset
+    double last_x = m_xs.back();
+    double last_y = m_ys.back();
+
+    // Work through the X values a batch at a time
+    while (count)
+    {
+        unsigned n = (count < BATCH) ? count : BATCH;
+
+        // Find the segment each X value falls into
+        for (unsigned k=0; k<n; ++k) segment[k] = hint = FindSegment(x[k], hint);
+
+        // Evaluate the cubics two at a time: y + diff * (c1 + diff * (c2 + diff * c3))
+        unsigned k = 0;
+        for (; k + 2 <= n; k += 2)
+        {
+            unsigned i0 = segment[k], i1 = segment[k + 1];
+            __m128d diff = _mm_sub_pd(_mm_loadu_pd(x + k), _mm_set_pd(m_xs[i1], m_xs[i0]));
+            __m128d p    = _mm_set_pd(m_c3s[i1], m_c3s[i0]);
+            p = _mm_add_pd(_mm_mul_pd(p, diff), _mm_set_pd(m_c2s[i1], m_c2s[i0]));
+            p = _mm_add_pd(_mm_mul_pd(p, diff), _mm_set_pd(m_c1s[i1], m_c1s[i0]));
+            p = _mm_add_pd(_mm_mul_pd(p, diff), _mm_set_pd(m_ys [i1], m_ys [i0]));
+            _mm_storeu_pd(y + k, p);
+        }
+
+        // Evaluate the odd one out, if there is one
+        if (k < n)
+        {
+            unsigned i = segment[k];
+            double diff = x[k] - m_xs[i];
+            y[k] = m_ys[i] + diff * (m_c1s[i] + diff * (m_c2s[i] + diff * m_c3s[i]));
+        }
+
+        // The last point in the dataset should give an exact result
+        for (k=0; k<n; ++k) if (x[k] == last_x) y[k] = last_y;
+
+        // Move on to the next batch
+        x     += n;
+        y     += n;
+        count -= n;
+    }
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// Bake() - Evaluates the spline at evenly spaced X values, from x0 to x1 inclusive
+//=========================================================================================================
+void CubicMonoSpline::Bake(double x0, double x1, double* y, unsigned count)
+{
+    const unsigned BATCH = 256;
+    double         x[BATCH];
+
+    // A single entry sits at x0
+    double step = (count > 1) ? (x1 - x0) / (count - 1) : 0;
+
+    // Generate the X values a batch at a time, and interpolate them.  They're in ascending order, so
+    // finding their segments is almost free
+    for (unsigned first=0; first<count; first += BATCH)
+    {
+        unsigned n = (count - first < BATCH) ? count - first : BATCH;
+        for (unsigned k=0; k<n; ++k) x[k] = (first + k == count - 1) ? x1 : x0 + (first + k) * step;
+        Interpolate(x, y + first, n);
+    }
+}
+//=========================================================================================================
@@ -15,8 +15,22 @@ public:
     // Call this find the interpolated Y value that corresponds to the given X value
     double  Interpolate(double x);
 
+    // Interpolates the Y value for each of "count" X values.  The X values may be in any order, but
+    // runs of ascending X values are the quickest
+    void    Interpolate(const double* x, double* y, unsigned count);
+
+    // Evaluates the spline at "count" evenly spaced X values from x0 to x1 (inclusive), for building
+    // a lookup table of any resolution
+    void    Bake(double x0, double x1, double* y, unsigned count);
+
 protected:
 
+    // Finds the segment that x falls into.  X values outside the spline use the first or last segment
+    unsigned FindSegment(double x);
+
+    // Finds the segment that x falls into, starting with the assumption that it's segment "hint"
+    unsigned FindSegment(double x, unsigned hint);
+
     vector<double>  m_xs;
     vector<double>  m_ys;
     vector<double>  m_c1s;
@@ -24,4 +38,3 @@ protected:
     vector<double>  m_c3s;
 };
 //=========================================================================================================
-
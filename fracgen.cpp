@@ -14,12 +14,21 @@
 #include "SavePoiDlg.h"
 #include "HueIndicator.h"
 #include <memory>
+#include <math.h>
 #include <vector>
 #include <map>
 
 using std::vector;
 using std::auto_ptr;
 
+// The timer that drives color cycling, how often it fires, and how often the frame rate is reported
+const UINT_PTR CYCLE_TIMER          = 1;
+const UINT     CYCLE_INTERVAL_MS    = 15;
+const double   CYCLE_REPORT_SECONDS = 2.0;
+
+// Color cycling starts out rotating through the whole lookup table in 8 seconds
+const double   CYCLE_DEFAULT_RATE   = CYCLE_LUT_SIZE / 8.0;
+
 
 //=========================================================================================================
 // CViewport - a CStatic class that we use for painting a bitmap into the viewport
@@ -52,6 +61,9 @@ protected:
     void    OnBack();
     void    OnRestart();
     void    OnRender();
+    void    OnRecolor();
+    U32     GetRenderMode();
+    bool    SetPanelSize(U32 cols, U32 rows, U32 tile_size, U32 samples);
     void    OnAbort();
     void    OnExit();
     void    OnAutoZoom();
@@ -64,6 +76,9 @@ protected:
     void    OnGreyscale();
     void    DrawViewport();
     void    ReshadeViewport();
+    void    StartCycling();
+    void    StopCycling();
+    void    OnTimer(UINT_PTR id);
     void    CenterZoom(bool zoom_in);
     void    Shade(double* fractal, pixel* image, U32 panel_area);
     void    SetUI(int state);
@@ -86,6 +101,19 @@ protected:
     DisplayBox    m_window;
     CViewport     m_viewport;
     HCURSOR       m_cursor;
+
+    // Color cycling: whether it's running, the rotation of the lookup table (in table entries), and how
+    // fast it rotates (in table entries per second)
+    bool          m_cycling;
+    double        m_cycle_offset;
+    double        m_cycle_rate;
+
+    // Color cycling frame timing: when the last frame was drawn, and the frames drawn and the time
+    // spent shading them since the frame rate was last reported
+    LARGE_INTEGER m_cycle_last_frame;
+    LARGE_INTEGER m_cycle_last_report;
+    U32           m_cycle_frames;
+    U64           m_cycle_shade_ticks;
  
 };
 //=========================================================================================================
@@ -192,32 +220,6 @@ class CApp : public CWinApp {public: BOOL InitInstance();} theApp;
 //=========================================================================================================
 
 
-//=========================================================================================================
-// AllocatePanel() - Allocate as much memory as we can for the rendering panel
-//=========================================================================================================
-U32 AllocatePanel()
-{
-    // 500 million pixels is the largest panel we can allocate
-    U32 count = 500000000;
-
-    for (int i = 0; i < 499; ++i)
-    {
-        try
-        {
-            panel = new pixel[count * sizeof pixel];
-            if (panel != nullptr) break;
-        }
-        catch (...) {}
-        count -= 1000000;
-    }
-
-    // Tell the caller how many pixels we allocated for the panel
-    return count;
-}
-//=========================================================================================================
-
-
-
 //=========================================================================================================
 // InitInstance() - The main-line code for the application
 //=========================================================================================================
@@ -235,12 +237,10 @@ BOOL CApp::InitInstance()
     // Count the number of logical processors we have
     cpu_count = GetLogicalProcessorCount();
 
-    // Allocate enough memory for the viewport
+    // Allocate enough memory for the viewport.  The panel buffer for full renders isn't allocated
+    // until a render starts
     viewport = new pixel[VIEWPORT_SIZE * VIEWPORT_SIZE];
 
-    // Allocate as much memory as we can for a rendering panel
-    max_panel_size = AllocatePanel();
-
     // And execute the main dialog
 	CMainDlg dlg;
 	m_pMainWnd = &dlg;
@@ -254,7 +254,12 @@ BOOL CApp::InitInstance()
 //=========================================================================================================
 // Constructor() - Called once to create the main dialog box
 //=========================================================================================================
-CMainDlg::CMainDlg(CWnd* pParent) : CDialogEx(IDD_MAIN_DLG, pParent) {}
+CMainDlg::CMainDlg(CWnd* pParent) : CDialogEx(IDD_MAIN_DLG, pParent)
+{
+    m_cycling      = false;
+    m_cycle_offset = 0;
+    m_cycle_rate   = CYCLE_DEFAULT_RATE;
+}
 //=========================================================================================================
 
 
@@ -268,11 +273,13 @@ BEGIN_MESSAGE_MAP(CMainDlg, CDialogEx)
     ON_WM_MOUSEMOVE()
     ON_WM_SETCURSOR()
     ON_WM_HSCROLL()
+    ON_WM_TIMER()
 
     ON_BN_CLICKED   (IDC_REDRAW,     OnRedraw     )
     ON_BN_CLICKED   (IDC_BACK,       OnBack       )
     ON_BN_CLICKED   (IDC_RESTART,    OnRestart    )
     ON_BN_CLICKED   (IDC_BIGPLOT,    OnRender     )
+    ON_BN_CLICKED   (IDC_RECOLOR,    OnRecolor    )
     ON_BN_CLICKED   (IDC_ABORT,      OnAbort      )
     ON_BN_CLICKED   (IDC_AUTOZOOM,   OnAutoZoom   )
     ON_BN_CLICKED   (IDC_SAVE_POI,   OnSavePOI    )
@@ -321,12 +328,25 @@ void CMainDlg::ReshadeViewport()
 {
     U32 i;
 
+    // Pick the shading pipeline for the current shader settings
+    Shader.SelectPipeline();
+
+    // Histogram-equalized shading needs the histogram of the viewport's escape counts
+    if (Shader.GetScheme() == CS_HISTOGRAM) CPlotter::BuildHistogram(MT_HISTOGRAM, dwell);
+
     // Tell the background threads to peform a reshade
     for (i = 0; i < cpu_count; ++i) Plotter[i].Start(MT_RESHADE);
 
     // Wait for the background threads to finish 
     for (i = 0; i < cpu_count; ++i) Plotter[i].Wait();
 
+    // If we're color cycling, the lookup table has to be rebuilt with the new settings
+    if (m_cycling)
+    {
+        CPlotter::PrepareCycle();
+        CPlotter::CycleFrame((U32)m_cycle_offset);
+    }
+
     // Force a repaint of the viewport
     GetDlgItem(IDC_VIEWPORT)->Invalidate(false);
 }
@@ -349,6 +369,18 @@ BOOL CMainDlg::OnInitDialog()
         Plotter[i].Spawn(GetSafeHwnd());
     }
 
+    // Start the thread that writes rendered panels to disk
+    PanelWriter.Init();
+    PanelWriter.Spawn(GetSafeHwnd());
+
+    // Start the threads that compress output data for the panel writer
+    for (U32 i=0; i<cpu_count; ++i)
+    {
+        Encoder[i].SetThreadID(i);
+        Encoder[i].Init();
+        Encoder[i].Spawn(GetSafeHwnd());
+    }
+
     // Let the base-class do it's thing
 	CDialogEx::OnInitDialog();
 
@@ -400,6 +432,9 @@ BOOL CMainDlg::OnInitDialog()
     // Read in the settings file
     ReadSettings();
 
+    // Add the user-defined gradients from the settings file to the list of color schemes
+    Shader.AddGradientNames((CComboBox*)GetDlgItem(IDC_CLR_SCHEME));
+
     // Add all of the places names to the appropriate dialog control
     pCB = (CComboBox*)GetDlgItem(IDC_PLACES);
     for (auto it=places.begin(); it != places.end(); ++it) pCB->AddString(L" " + it->second.name);
@@ -419,6 +454,9 @@ BOOL CMainDlg::OnInitDialog()
     // Give the user some hints
     wPrintf(0, L"Hint: Shift-click to re-center the image on the selected point");
     wPrintf(0, L"Hint: PageUp to zoom in by 2X.  PageDn to zoom out by 2X"); 
+    wPrintf(0, L"Hint: F5 to start/stop color cycling.  F6/F7 to slow down/speed up, F8 to reverse");
+    wPrintf(0, L"Hint: F9 to turn automatic dwell on/off");
+    wPrintf(0, L"Hint: F11 to stitch panel_XXXX.bmp files into the output image");
   
 	return TRUE;  // return TRUE  unless you set the focus to a control
 }
@@ -786,10 +824,13 @@ void CMainDlg::DrawViewport()
     ps.bitmap          = viewport;
     ps.rows            = VIEWPORT_SIZE;
     ps.columns         = VIEWPORT_SIZE;
+    ps.render_mode     = RM_COLUMNS;
     ps.panel_width     = VIEWPORT_SIZE;
+    ps.panel_height    = VIEWPORT_SIZE;
     ps.coord           = coord_stack.top();
     ps.pixel_size      = ps.coord.span.real / ps.columns;
     ps.oversample      = GetOversampleFromGUI();
+    ps.dwell           = dwell;
 
     // Render the new view
     Worker.Spawn(GetSafeHwnd(), MT_PLOT);
@@ -857,6 +898,170 @@ void CMainDlg::OnGreyscale()
 
 
 
+//=========================================================================================================
+// GetRenderMode() - Returns the way a full render will be split into panels (one of the RM_xxx constants)
+//=========================================================================================================
+U32 CMainDlg::GetRenderMode()
+{
+    // A PNG file is written a full row at a time from the top down, so it has to be rendered in bands
+    return (output_format == OF_PNG) ? RM_BANDS : render_mode;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// SetPanelSize() - Determines the size of the panels that a full render will be split into, and fills
+//                  in the render mode and panel dimensions in the plot settings.
+//
+// Panels are aligned to the tile grid of the output format, or to "tile_size" if it is larger.  If
+// "samples" is non-zero, the escape data for that many samples per pixel is kept alongside each panel.
+//
+// Returns false (after complaining to the user) if the image can't be rendered
+//=========================================================================================================
+bool CMainDlg::SetPanelSize(U32 cols, U32 rows, U32 tile_size, U32 samples)
+{
+    U32 panel_width, panel_height;
+
+    // Find out how the image will be split into panels
+    U32 mode = GetRenderMode();
+
+    // The size fields in a BMP header are 32 bits, so BMP files are limited to 4 GB
+    if (output_format == OF_BMP && (double)(((U64)cols * 3 + 3) & ~3) * rows + 54 > 0xFFFFFFFF)
+    {
+        Popup(L"This image is too large for a BMP file.\n\nSet OUTPUT_FORMAT = tiff or png in settings.txt");
+        return false;
+    }
+
+    // Each pixel of a panel costs this many bytes: its color, plus the escape value of each of its
+    // samples if we're keeping them
+    U64 pixel_bytes = sizeof(pixel) + (U64)samples * sizeof(escape_sample);
+
+    // The memory budget has to hold two halves of the panel buffer.  500 million pixels is the
+    // largest panel we'll use
+    U64 budget_pixels = (U64)memory_budget * 1024 * 1024 / 2 / pixel_bytes;
+    U32 half_panel_size = (budget_pixels > 500000000) ? 500000000 : (U32)budget_pixels;
+
+    // Each half of the panel buffer must be able to hold at least one column (or in band mode, one row)
+
+    // Make sure the whole thing will fit into memory
+    if ((mode == RM_COLUMNS && rows > half_panel_size) || (mode == RM_BANDS && cols > half_panel_size))
+    {
+        Popup(L"This is too big to fit into memory.\n\nIncrease MEMORY_BUDGET in settings.txt");
+        return false;
+    }
+
+    // Determine the size of a panel that will fit into half of our panel buffer
+    switch (mode)
+    {
+    // Column panels are full-height.  For convenience when writing/reading BMP files, round the
+    // panel width down to a multiple of 4
+    case RM_COLUMNS:
+        panel_height = rows;
+        panel_width  = half_panel_size / rows;
+        while (panel_width % 4) --panel_width;
+        break;
+
+    // Bands are full-width
+    case RM_BANDS:
+        panel_width  = cols;
+        panel_height = half_panel_size / cols;
+        break;
+
+    // Tiles are as close to square as the image allows, with a width that is a multiple of 16
+    default:
+        panel_width  = (U32)sqrt((double)half_panel_size) & ~15;
+        if (panel_width > cols) panel_width = cols;
+        panel_height = panel_width ? half_panel_size / panel_width : 0;
+        break;
+    }
+
+    // A panel never needs to be bigger than the image, and the panel buffer will be sized to fit it
+    if (panel_width  > cols) panel_width  = cols;
+    if (panel_height > rows) panel_height = rows;
+
+    // Make sure the memory budget can hold a panel at all
+    if (panel_width == 0 || panel_height == 0)
+    {
+        Popup(L"This is too big to fit into memory.\n\nIncrease MEMORY_BUDGET in settings.txt");
+        return false;
+    }
+
+    // Find the tile size of the output format.  All of our tile sizes are powers of two, so the larger
+    // of this and the caller's tile size is a multiple of both
+    U32 format_tile_size = (output_format == OF_TIFF) ? TIFF_TILE_SIZE : (output_format == OF_DZI) ? DZI_TILE_SIZE : 0;
+    if (format_tile_size > tile_size) tile_size = format_tile_size;
+
+    // If we need to, round the panel dimensions down to a multiple of the tile size so that every panel
+    // starts on a tile boundary.  (Unless a single panel spans the image in that direction)
+    if (tile_size)
+    {
+        if (panel_width  < cols) panel_width  -= panel_width  % tile_size;
+        if (panel_height < rows) panel_height -= panel_height % tile_size;
+        if (panel_width == 0 || panel_height == 0)
+        {
+            Popup(L"This is too big to fit into memory.\n\nIncrease MEMORY_BUDGET in settings.txt");
+            return false;
+        }
+    }
+
+    // Fill in the plot settings
+    ps.render_mode  = mode;
+    ps.panel_width  = panel_width;
+    ps.panel_height = panel_height;
+
+    // Tell the caller that all is well
+    return true;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// OnRecolor() - Re-shades the last full render (using the current color settings) from the escape data
+//               that was saved with it
+//=========================================================================================================
+void CMainDlg::OnRecolor()
+{
+    // Fetch the value of the GUI fields
+    UpdateData(true);
+
+    // Open the escape-data file
+    if (!EscapeReader.Open(L"render.esc"))
+    {
+        Popup(L"Unable to open render.esc\n\nSet ESCAPE_DATA = on in settings.txt, then do a full render to create it");
+        return;
+    }
+
+    // Fetch the header that describes the render
+    const ESCAPEHDR& hdr = EscapeReader.Header();
+
+    // Every panel must start on a tile boundary of the escape-data file
+    if (!SetPanelSize(hdr.cols, hdr.rows, ESCAPE_TILE_SIZE, 0))
+    {
+        EscapeReader.Close();
+        return;
+    }
+
+    // Turn off the user interface
+    SetUI(UI_BUSY_RENDER);
+
+    // Set up the rest of the plot settings from the header.  The worker thread allocates the panel
+    // buffer when the render starts
+    ps.bitmap            = nullptr;
+    ps.rows              = hdr.rows;
+    ps.columns           = hdr.cols;
+    ps.coord.center.real = hdr.center_real;
+    ps.coord.center.imag = hdr.center_imag;
+    ps.coord.span.real   = hdr.span_real;
+    ps.coord.span.imag   = hdr.span_imag;
+    ps.pixel_size        = ps.coord.span.real / ps.columns;
+    ps.oversample        = (hdr.samples_per_pixel == 1) ? 0 : hdr.samples_per_pixel;
+
+    // Recolor the render
+    Worker.Spawn(GetSafeHwnd(), MT_RECOLOR);
+}
+//=========================================================================================================
+
+
 //=========================================================================================================
 // OnRender() - Renders the image to a file
 //=========================================================================================================
@@ -865,10 +1070,13 @@ void CMainDlg::OnRender()
     // Fetch the value of the GUI fields
     UpdateData(true);
 
+    // Tiled renders never hold a full row or column in memory, so they can be much wider
+    U32 max_width = (GetRenderMode() == RM_TILES) ? 0x7FFFFFFF : 1000000;
+
     // Make sure the render width is something reasonable
-    if (render_width < 10 || render_width > 1000000)
+    if (render_width < 10 || render_width > max_width)
     {
-        Popup(L"Render width must be between 10 and 1000000");
+        Popup(L"Render width must be between 10 and %u", max_width);
         return;
     }
 
@@ -880,17 +1088,35 @@ void CMainDlg::OnRender()
     T_COORD coord = GetLassodCoords(false);
 
     // Determine how many rows are going to be in this image
-    U32 rows = (U32)(cols * coord.span.imag / coord.span.real + .5);
+    double height = cols * coord.span.imag / coord.span.real + .5;
 
-    // Make sure the whole thing will fit into memory
-    if (rows > max_panel_size)
+    // The image height has to fit into the height field of the image header
+    if (height > 0x7FFFFFFF)
     {
-        Popup(L"This is too big to fit into memory");
+        Popup(L"This image is too tall");
         return;
     }
-    
+
+    // This is how many rows the resulting image is going to have
+    U32 rows = (U32)height;
+
+    // This is how many samples we compute for each pixel
+    U32 oversample = GetOversampleFromGUI();
+    U32 spp = oversample ? oversample : 1;
+
+    // Decide how this image will be split into panels.  Escape data is compressed a tile at a time, so
+    // if we're saving it, every panel must start on a tile boundary of the escape-data file
+    if (export_escape_data)
+    {
+        if (!SetPanelSize(cols, rows, ESCAPE_TILE_SIZE, spp)) return;
+    }
+    else
+    {
+        if (!SetPanelSize(cols, rows, 0, 0)) return;
+    }
+
     // Determine how many megapixels the fully rendered image will be
-    double megapixels = rows * cols / 1000000.0;
+    double megapixels = (double)rows * cols / 1000000.0;
     CString unit = L"Megapixels";
 
     // If we're over a gigapixel, change the units
@@ -911,20 +1137,14 @@ void CMainDlg::OnRender()
     // Turn off the user interface
     SetUI(UI_BUSY_RENDER);
     
-    // Determine the maximum width of a panel that will fit into our panel buffer
-    U32 panel_width = max_panel_size / rows;
-
-    // For convenience when writing/reading BMP files, round this down to a multiple of 4
-    while (panel_width % 4) --panel_width;
-    
-    // Set up the plot settings
-    ps.bitmap          = panel;
+    // Set up the rest of the plot settings.  The worker thread allocates the panel buffer when the
+    // render starts
+    ps.bitmap          = nullptr;
     ps.rows            = rows;
     ps.columns         = cols;
-    ps.panel_width     = panel_width;
     ps.coord           = coord;
     ps.pixel_size      = ps.coord.span.real / ps.columns;
-    ps.oversample      = GetOversampleFromGUI();
+    ps.oversample      = oversample;
 
     // Render the new view
     Worker.Spawn(GetSafeHwnd(), MT_PLOT);
@@ -943,6 +1163,9 @@ LRESULT CMainDlg::OnThStop(WPARAM iSite, LPARAM Value)
      // Force a repaint of the viewport
     GetDlgItem(IDC_VIEWPORT)->Invalidate(false);
 
+    // If the worker planned the dwell limit, show it to the user
+    if (auto_dwell) UpdateData(false);
+
     // Turn the user interface back on
     SetUI(UI_IDLE);
 
@@ -1075,6 +1298,14 @@ void CMainDlg::OnColorScheme()
     // The fixed hue slider is only enabled when the shader scheme is "fixed hue"
     GetDlgItem(IDC_FIXED_HUE)->EnableWindow(scheme == CS_FIXED_HUE);
 
+    // Distance-estimation shading needs distance estimates.  If the viewport was plotted without
+    // them, it has to be plotted again
+    if (scheme == CS_DEM && !viewport_has_estimates)
+    {
+        DrawViewport();
+        return;
+    }
+
     // And repaint the viewport in our current color scheme
     ReshadeViewport();
 }
@@ -1109,6 +1340,10 @@ LRESULT CMainDlg::OnProgress(WPARAM iSite, LPARAM Value)
         s = L"Aborted";
         break;
 
+    case PROGRESS_FAILED:
+        s = L"Failed";
+        break;
+
     default:
         s.Format(L"%i%%", Value);
     }
@@ -1264,6 +1499,95 @@ void CMainDlg::CenterZoom(bool zoom_in)
 //=========================================================================================================
 
 
+//=========================================================================================================
+// StartCycling() - Starts animating the colors of the viewport.  The escape values of the viewport are
+//                  computed once, then every frame just rotates the color lookup table and reshades
+//=========================================================================================================
+void CMainDlg::StartCycling()
+{
+    // We can't cycle colors while the viewport is being plotted
+    if (ui_state != UI_IDLE || m_cycling) return;
+
+    // Pick the shading options, and convert the viewport into lookup table indices
+    Shader.SelectPipeline();
+    CPlotter::PrepareCycle();
+
+    // Start the frame timing
+    QueryPerformanceCounter(&m_cycle_last_frame);
+    m_cycle_last_report = m_cycle_last_frame;
+    m_cycle_frames      = 0;
+    m_cycle_shade_ticks = 0;
+
+    // And start the animation
+    m_cycling = true;
+    SetTimer(CYCLE_TIMER, CYCLE_INTERVAL_MS, nullptr);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// StopCycling() - Stops animating the colors of the viewport, and puts the original colors back
+//=========================================================================================================
+void CMainDlg::StopCycling()
+{
+    if (!m_cycling) return;
+
+    KillTimer(CYCLE_TIMER);
+    m_cycling      = false;
+    m_cycle_offset = 0;
+
+    // If nothing else is going on, repaint the viewport with its ordinary colors
+    if (ui_state == UI_IDLE) ReshadeViewport();
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// OnTimer() - Called every CYCLE_INTERVAL_MS while color cycling, to draw the next frame
+//=========================================================================================================
+void CMainDlg::OnTimer(UINT_PTR id)
+{
+    LARGE_INTEGER now, frequency, shaded;
+
+    // If this isn't the color cycling timer, let the dialog handle it
+    if (id != CYCLE_TIMER || !m_cycling)
+    {
+        CDialogEx::OnTimer(id);
+        return;
+    }
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+
+    // Rotate the lookup table by however far it should have moved since the last frame
+    double seconds = (double)(now.QuadPart - m_cycle_last_frame.QuadPart) / frequency.QuadPart;
+    m_cycle_last_frame = now;
+    m_cycle_offset = fmod(m_cycle_offset + m_cycle_rate * seconds, CYCLE_LUT_SIZE);
+    if (m_cycle_offset < 0) m_cycle_offset += CYCLE_LUT_SIZE;
+
+    // Shade the frame on all of the cores, and have it painted
+    CPlotter::CycleFrame((U32)m_cycle_offset);
+    QueryPerformanceCounter(&shaded);
+    GetDlgItem(IDC_VIEWPORT)->Invalidate(false);
+
+    // Keep track of the frame timing
+    ++m_cycle_frames;
+    m_cycle_shade_ticks += shaded.QuadPart - now.QuadPart;
+
+    // Every few seconds, report the frame rate and how long each frame took to shade
+    double elapsed = (double)(now.QuadPart - m_cycle_last_report.QuadPart) / frequency.QuadPart;
+    if (elapsed >= CYCLE_REPORT_SECONDS)
+    {
+        double shade_ms = 1000.0 * m_cycle_shade_ticks / frequency.QuadPart / m_cycle_frames;
+        wPrintf(0, L"Color cycling: %.1lf fps, %.2lf ms per frame to shade", m_cycle_frames / elapsed, shade_ms);
+        m_cycle_last_report = now;
+        m_cycle_frames      = 0;
+        m_cycle_shade_ticks = 0;
+    }
+}
+//=========================================================================================================
+
+
 //=========================================================================================================
 // PreTranslateMessage() - Perform special handling for the escape key
 //=========================================================================================================
@@ -1286,6 +1610,43 @@ BOOL CMainDlg::PreTranslateMessage(MSG* pMsg)
         return true;
     }
 
+    // F5 starts and stops color cycling
+    if (pMsg->message == WM_KEYDOWN && pMsg->wParam == VK_F5)
+    {
+        if (m_cycling) StopCycling(); else StartCycling();
+        return true;
+    }
+
+    // F6 and F7 slow color cycling down and speed it up, and F8 reverses it
+    if (pMsg->message == WM_KEYDOWN && (pMsg->wParam == VK_F6 || pMsg->wParam == VK_F7 || pMsg->wParam == VK_F8))
+    {
+        if (pMsg->wParam == VK_F6) m_cycle_rate /= 2;
+        if (pMsg->wParam == VK_F7) m_cycle_rate *= 2;
+        if (pMsg->wParam == VK_F8) m_cycle_rate = -m_cycle_rate;
+        if (m_cycling) wPrintf(0, L"Color cycling at %.0lf palette entries per second", m_cycle_rate);
+        return true;
+    }
+
+    // F9 turns automatic dwell on and off.  Turning it on re-plots the view with a dwell of its own
+    if (pMsg->message == WM_KEYDOWN && pMsg->wParam == VK_F9)
+    {
+        auto_dwell = !auto_dwell;
+        wPrintf(0, L"Automatic dwell is %s", auto_dwell ? L"on" : L"off");
+        if (auto_dwell && ui_state == UI_IDLE) DrawViewport();
+        return true;
+    }
+
+    // F11 stitches panel files together into the output image
+    if (pMsg->message == WM_KEYDOWN && pMsg->wParam == VK_F11)
+    {
+        if (ui_state == UI_IDLE)
+        {
+            SetUI(UI_BUSY_RENDER);
+            Worker.Spawn(GetSafeHwnd(), MT_STITCH);
+        }
+        return true;
+    }
+
     // If "OnPreTranslateMessage" returned false, let CDialog do
     // normal message translation and processing
     return CDialogEx::PreTranslateMessage(pMsg);
@@ -1302,12 +1663,16 @@ void CMainDlg::SetUI(int state)
     // Record what state the user interface is in
     ui_state = state;
 
+    // Color cycling only runs while the user interface is idle
+    if (state != UI_IDLE) StopCycling();
+
     bool flag = (state == UI_IDLE);
 
     GetDlgItem(IDC_REDRAW      )->EnableWindow(flag);
     GetDlgItem(IDC_BACK        )->EnableWindow(flag);
     GetDlgItem(IDC_RESTART     )->EnableWindow(flag);
     GetDlgItem(IDC_BIGPLOT     )->EnableWindow(flag);
+    GetDlgItem(IDC_RECOLOR     )->EnableWindow(flag);
     GetDlgItem(IDC_DWELL       )->EnableWindow(flag);
     GetDlgItem(IDC_OVERSAMPLE  )->EnableWindow(flag);
     GetDlgItem(IDC_AUTOZOOM    )->EnableWindow(flag);
@@ -8,7 +8,9 @@ typedef unsigned char  U8;
 
 struct complex    {double real, imag;};
 struct pixel      {U8 b, g, r, a;};
-struct escape     {int iter; double distance;};
+// "iter" is the escape count (0 if the point never escaped), and "work" is the number of iterations
+// it took to find that out
+struct escape     {int iter; int work; double distance; double estimate;};
 struct frac_value {escape e[9];};
 
 